@@ -0,0 +1,189 @@
+#pragma once
+
+#include <linux/bitops.h>
+#include <linux/types.h>
+
+#include "game.h"
+
+/* Occupancy bitboards: bit i of pieces[BB_SIDE(p)] is set when player p owns
+ * grid i. The engines convert the character table once at entry and then
+ * work on these masks only.
+ */
+#if N_GRIDS <= 16
+typedef u16 bitboard_t;
+#define bb_popcount(x) hweight16(x)
+#elif N_GRIDS <= 32
+typedef u32 bitboard_t;
+#define bb_popcount(x) hweight32(x)
+#else
+typedef u64 bitboard_t;
+#define bb_popcount(x) hweight64(x)
+#endif
+
+#define BB_ALL ((bitboard_t) (~0ULL >> (64 - N_GRIDS)))
+#define BB_CELL(i) ((bitboard_t) 1 << (i))
+#define BB_SIDE(player) ((player) == 'X')
+
+/* Number of GOAL-long segments covered by the four entries of lines[] */
+#define N_LINE_SEGMENTS                         \
+    (2 * BOARD_SIZE * (BOARD_SIZE - GOAL + 1) + \
+     2 * (BOARD_SIZE - GOAL + 1) * (BOARD_SIZE - GOAL + 1))
+
+struct bitboard {
+    bitboard_t pieces[2];
+};
+
+/* A cell lies on at most GOAL segments in each of the four directions */
+#define MAX_CELL_LINES (4 * GOAL)
+
+/* The eight symmetries of the square board: under symmetry s, grid i moves
+ * to sym_cells[s][i], and sym_inverse[s] undoes that. s = 0 is the identity.
+ */
+#define N_SYMMETRIES 8
+
+/* Constant tables of the configured board, generated by geometry-gen:
+ * line_masks[] holds the grids of every GOAL-long segment, in the order
+ * check_win() walks lines[], and line_ends[] the grids that would extend
+ * each one past GOAL. line_cells[] lists the same segments grid by grid, and
+ * line_end_cells[] the grids of line_ends[], N_GRIDS where the segment
+ * touches the edge. line_weights[k] is what k pieces of one side score on
+ * a segment, and segment_scores[o][x] what a segment holding o O pieces and
+ * x X pieces adds to the score of 'O'. cell_lines[c] lists the indices of
+ * the cell_nr_lines[c] segments through grid c.
+ */
+#include "geometry.h"
+
+static inline void bb_from_table(struct bitboard *b, const char *table)
+{
+    b->pieces[0] = b->pieces[1] = 0;
+    for (int i = 0; i < N_GRIDS; i++)
+        if (table[i] != ' ')
+            b->pieces[BB_SIDE(table[i])] |= BB_CELL(i);
+}
+
+static inline bitboard_t bb_empty(const struct bitboard *b)
+{
+    return BB_ALL & ~(b->pieces[0] | b->pieces[1]);
+}
+
+/* Toggles the grid, so playing the same move again takes it back */
+static inline void bb_play(struct bitboard *b, int move, char player)
+{
+    b->pieces[BB_SIDE(player)] ^= BB_CELL(move);
+}
+
+/* Store the empty grids into @moves in ascending order, like
+ * available_moves() does for a character table.
+ */
+static inline int bb_moves(const struct bitboard *b, int *moves)
+{
+    bitboard_t empty = bb_empty(b);
+    int n = 0;
+    while (empty) {
+        moves[n++] = __ffs64(empty);
+        empty &= empty - 1;
+    }
+    return n;
+}
+
+/* Whether @pieces complete segment @i, and without ALLOW_EXCEED, do not
+ * continue past either end of it
+ */
+static inline bool bb_owns_line(bitboard_t pieces, int i)
+{
+    if ((pieces & line_masks[i]) != line_masks[i])
+        return false;
+    return ALLOW_EXCEED || !(pieces & line_ends[i]);
+}
+
+/* Whether the piece just played on @move completed a line: only segments
+ * through it can have.
+ */
+static inline bool bb_completes_line(bitboard_t pieces, int move)
+{
+    for (int k = 0; k < cell_nr_lines[move]; k++)
+        if (bb_owns_line(pieces, cell_lines[move][k]))
+            return true;
+    return false;
+}
+
+/* Same contract as check_win(): the winner, 'D' for a full board, or ' ' */
+static inline char bb_check_win(const struct bitboard *b)
+{
+    for (int i = 0; i < N_LINE_SEGMENTS; i++) {
+        if (bb_owns_line(b->pieces[0], i))
+            return 'O';
+        if (bb_owns_line(b->pieces[1], i))
+            return 'X';
+    }
+    return bb_empty(b) ? ' ' : 'D';
+}
+
+/* Incremental counterpart of get_score() in util.h and bb_check_win(): the
+ * pieces of each side on every segment, and what they add up to, updated by
+ * every move in O(segments through the cell) so that a leaf is evaluated in
+ * O(1).
+ */
+struct bb_eval {
+    u8 count[N_LINE_SEGMENTS][2];
+    u8 nr_won[2]; /* segments filled by each side */
+    int score;    /* get_score() for 'O' */
+};
+
+static inline void bb_eval_update(struct bb_eval *e,
+                                  int move,
+                                  char player,
+                                  int delta)
+{
+    int side = BB_SIDE(player);
+    for (int k = 0; k < cell_nr_lines[move]; k++) {
+        u8 *count = e->count[cell_lines[move][k]];
+        e->score -= segment_scores[count[0]][count[1]];
+        e->nr_won[side] -= count[side] == GOAL;
+        count[side] += delta;
+        e->nr_won[side] += count[side] == GOAL;
+        e->score += segment_scores[count[0]][count[1]];
+    }
+}
+
+static inline void bb_eval_init(struct bb_eval *e, const struct bitboard *b)
+{
+    e->nr_won[0] = e->nr_won[1] = 0;
+    e->score = 0;
+    for (int i = 0; i < N_LINE_SEGMENTS; i++) {
+        for (int side = 0; side < 2; side++) {
+            e->count[i][side] = bb_popcount(b->pieces[side] & line_masks[i]);
+            e->nr_won[side] += e->count[i][side] == GOAL;
+        }
+        e->score += segment_scores[e->count[i][0]][e->count[i][1]];
+    }
+}
+
+static inline void bb_eval_play(struct bb_eval *e, int move, char player)
+{
+    bb_eval_update(e, move, player, 1);
+}
+
+static inline void bb_eval_undo(struct bb_eval *e, int move, char player)
+{
+    bb_eval_update(e, move, player, -1);
+}
+
+static inline int bb_eval_score(const struct bb_eval *e, char player)
+{
+    return BB_SIDE(player) ? -e->score : e->score;
+}
+
+/* Same contract as bb_check_win() for positions reached by legal play */
+static inline char bb_eval_winner(const struct bb_eval *e,
+                                  const struct bitboard *b)
+{
+    /* A filled segment only wins if it does not extend into a longer line */
+    if (!ALLOW_EXCEED && (e->nr_won[0] || e->nr_won[1]))
+        return bb_check_win(b);
+    if (e->nr_won[0])
+        return 'O';
+    if (e->nr_won[1])
+        return 'X';
+    return bb_empty(b) ? ' ' : 'D';
+}
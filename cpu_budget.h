@@ -0,0 +1,34 @@
+#pragma once
+
+#include <linux/atomic.h>
+#include <linux/cpumask.h>
+#include <linux/minmax.h>
+
+/* CPUs taken by the searches of every game: one per MCTS worker, and one per
+ * negamax search and per helper it runs. Searches add what they use for as
+ * long as they run, optional threads are only started on CPUs left over.
+ */
+extern atomic_t kxo_busy_cpus;
+
+static inline void cpu_budget_take(unsigned int n)
+{
+    atomic_add(n, &kxo_busy_cpus);
+}
+
+static inline void cpu_budget_put(unsigned int n)
+{
+    atomic_sub(n, &kxo_busy_cpus);
+}
+
+/* Take up to @want of the online CPUs no search uses, returns how many */
+static inline unsigned int cpu_budget_claim(unsigned int want)
+{
+    int busy = atomic_read(&kxo_busy_cpus);
+    do {
+        int idle = (int) num_online_cpus() - busy;
+        if (idle <= 0 || !want)
+            return 0;
+        want = min_t(unsigned int, want, idle);
+    } while (!atomic_try_cmpxchg(&kxo_busy_cpus, &busy, busy + want));
+    return want;
+}
@@ -0,0 +1,307 @@
+/* Benchmark the engines on the host for the configured BOARD_SIZE, GOAL and
+ * ALLOW_EXCEED. mcts.c, negamax.c and the rest of the engine sources are built
+ * unchanged against the kernel stand-ins under host/.
+ *
+ *   moves     ms per move of MCTS and negamax on fixed positions, best of
+ *             BENCH_REPEATS runs, every run with a cold transposition table
+ *   cache     seeded MCTS-versus-negamax games with the result cache off and
+ *             on, which must end with the same results. Every search starts
+ *             from a cold transposition table, so it only depends on the
+ *             position
+ *   playouts  mean reward of the batched playout kernels against a playout
+ *             on a character table, and playouts per second of every kernel
+ *             in MCTS searches with mcts_playouts=256
+ *
+ * Usage: engine-bench [moves|cache|playouts]...
+ * Exits non-zero when a cached game ends differently or a kernel is off.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitboard.h"
+#include "cpu_budget.h"
+#include "game.h"
+#include "mcts.h"
+#include "negamax.h"
+#include "playout.h"
+#include "result_cache.h"
+#include "tablebase.h"
+#include "xoroshiro.h"
+#include "zobrist.h"
+
+#define BENCH_REPEATS 6
+#define BENCH_OPENINGS 4 /* positions per opening length */
+#define BENCH_GAMES 10
+#define BENCH_PLAYOUTS 256
+#define BENCH_SAMPLES 65536 /* playouts per kernel for the reward check */
+
+atomic_t kxo_busy_cpus = ATOMIC_INIT(0);
+
+static char stats[PAGE_SIZE];
+
+static void set_param(const char *name, const char *value)
+{
+    if (host_param_set(name, value)) {
+        fprintf(stderr, "engine-bench: no parameter %s\n", name);
+        exit(1);
+    }
+}
+
+/* Play @plies random moves from the empty board, none of which ends the game */
+static void opening(char *table, int plies, struct state_array *rng)
+{
+    char player = 'O';
+
+    memset(table, ' ', N_GRIDS);
+    for (int i = 0; i < plies; i++) {
+        int moves[N_GRIDS];
+        int n = available_moves(table, moves);
+        int move = moves[xoro_bounded(rng, n)];
+        table[move] = player;
+        if (check_win(table) != ' ') {
+            table[move] = ' ';
+            break;
+        }
+        player ^= 'O' ^ 'X';
+    }
+}
+
+static char side_to_move(const char *table)
+{
+    int n = 0;
+    for (int i = 0; i < N_GRIDS; i++)
+        n += table[i] != ' ';
+    return n & 1 ? 'X' : 'O';
+}
+
+static double move_ms(const char *table, bool use_mcts)
+{
+    char player = side_to_move(table);
+    char copy[N_GRIDS];
+    double best = 0;
+
+    for (int r = 0; r < BENCH_REPEATS; r++) {
+        memcpy(copy, table, N_GRIDS);
+        zobrist_clear();
+        ktime_t start = ktime_get();
+        if (use_mcts)
+            mcts(NULL, copy, player, 0);
+        else
+            negamax_predict(copy, player);
+        double ms = (ktime_get() - start) / 1e6;
+        if (!r || ms < best)
+            best = ms;
+    }
+    return best;
+}
+
+static void bench_moves(void)
+{
+    struct state_array rng;
+    char table[N_GRIDS];
+    double sum[2] = {0, 0};
+    int n = 0;
+
+    set_param("result_cache", "0");
+    printf("moves: ms/move, best of %d, mcts_iterations %d, negamax depth "
+           "%d\n",
+           BENCH_REPEATS, ITERATIONS, 6);
+    xoro_seed(&rng, 1);
+    for (int plies = 0; plies <= 4; plies += 2) {
+        for (int k = 0; k < (plies ? BENCH_OPENINGS : 1); k++) {
+            opening(table, plies, &rng);
+            double ms[2] = {move_ms(table, true), move_ms(table, false)};
+            printf("  %d plies #%d  mcts %8.2f  negamax %8.2f\n", plies, k,
+                   ms[0], ms[1]);
+            sum[0] += ms[0];
+            sum[1] += ms[1];
+            n++;
+        }
+    }
+    printf("  mean        mcts %8.2f  negamax %8.2f\n", sum[0] / n,
+           sum[1] / n);
+}
+
+/* Play game @g from its seeded opening, MCTS as 'O' and negamax as 'X', and
+ * record the canonical key of every position reached into @keys and the
+ * number of moves into @n. Returns the result as check_win() gives it.
+ */
+static char play_game(int g, u64 *keys, int *n)
+{
+    struct zobrist_keys z = {0};
+    struct state_array rng;
+    char table[N_GRIDS];
+    char win;
+    int sym;
+
+    xoro_seed(&rng, g + 1);
+    opening(table, 2, &rng);
+    for (int i = 0; i < N_GRIDS; i++)
+        if (table[i] != ' ')
+            zobrist_keys_play(&z, i, table[i]);
+    char player = side_to_move(table);
+    for (*n = 0; (win = check_win(table)) == ' '; player ^= 'O' ^ 'X') {
+        /* A search from a cold table only depends on the position */
+        zobrist_clear();
+        int move = player == 'O' ? mcts(NULL, table, player, g)
+                                 : negamax_predict(table, player).move;
+        if (move < 0)
+            break;
+        table[move] = player;
+        zobrist_keys_play(&z, move, player);
+        keys[(*n)++] = zobrist_canonical(&z, &sym);
+    }
+    return win;
+}
+
+/* A hit replays the move searched for a symmetric position, which need not be
+ * the one a search of this orientation would pick. So the games may go
+ * different ways with the cache, but must end the same.
+ */
+static int bench_cache(void)
+{
+    static u64 keys[2][BENCH_GAMES][N_GRIDS];
+    int n_moves[2][BENCH_GAMES];
+    char results[2][BENCH_GAMES];
+    double ms[2];
+
+    printf("cache: %d seeded MCTS-versus-negamax games\n", BENCH_GAMES);
+    /* Off first, so the counters only cover the games with the cache */
+    for (int on = 0; on < 2; on++) {
+        set_param("result_cache", on ? "1" : "0");
+        ktime_t start = ktime_get();
+        for (int g = 0; g < BENCH_GAMES; g++)
+            results[on][g] = play_game(g, keys[on][g], &n_moves[on][g]);
+        ms[on] = (ktime_get() - start) / 1e6;
+    }
+
+    int same_games = 0, same_results = 0;
+    for (int g = 0; g < BENCH_GAMES; g++) {
+        same_results += results[0][g] == results[1][g];
+        same_games += n_moves[0][g] == n_moves[1][g] &&
+                      !memcmp(keys[0][g], keys[1][g],
+                              n_moves[0][g] * sizeof(u64));
+    }
+    printf("  off %.1f ms, on %.1f ms, same positions %d, same results %d\n",
+           ms[0], ms[1], same_games, same_results);
+    result_cache_stats_show(stats);
+    for (char *line = strtok(stats, "\n"); line; line = strtok(NULL, "\n"))
+        printf("  %s\n", line);
+    return same_results == BENCH_GAMES ? 0 : 1;
+}
+
+/* A random playout on a character table, the reference of the kernels.
+ * Returns the half points of the player who moved into @table.
+ */
+static unsigned int reference_playout(const char *table,
+                                      char player,
+                                      struct state_array *rng)
+{
+    char t[N_GRIDS];
+    char win;
+
+    memcpy(t, table, N_GRIDS);
+    while ((win = check_win(t)) == ' ') {
+        int moves[N_GRIDS];
+        int n = available_moves(t, moves);
+        t[moves[xoro_bounded(rng, n)]] = player;
+        player ^= 'O' ^ 'X';
+    }
+    return calculate_win_value(win, side_to_move(table) ^ 'O' ^ 'X') >>
+           (FIXED_SCALE_BITS - 1);
+}
+
+static int bench_playouts(void)
+{
+    static struct playout_lanes lanes;
+    struct state_array rng;
+    struct bitboard board;
+    char table[N_GRIDS];
+    int failed = 0;
+
+    printf("playouts: mean reward over %d playouts\n", BENCH_SAMPLES);
+    xoro_seed(&rng, 2);
+    for (int plies = 0; plies <= 4; plies += 2) {
+        opening(table, plies, &rng);
+        char player = side_to_move(table);
+        bb_from_table(&board, table);
+
+        unsigned long half_points = 0;
+        for (int i = 0; i < BENCH_SAMPLES; i++)
+            half_points += reference_playout(table, player, &rng);
+        double expected = half_points / (2.0 * BENCH_SAMPLES);
+        printf("  %d plies  reference %.4f", plies, expected);
+
+        /* Five standard errors of the difference of two sampled means of a
+         * reward in [0, 1], as the reference is sampled too and a run makes
+         * some 40 comparisons over the boards of bench-all
+         */
+        double tolerance = 5 * 0.5 * __builtin_sqrt(2.0 / BENCH_SAMPLES);
+        for (enum playout_kernel k = PLAYOUT_BITSLICE; k < NR_PLAYOUT_KERNELS;
+             k++) {
+            enum playout_kernel kernel = playout_kernel_select(k + 1);
+            if (kernel != k)
+                continue;
+            half_points = playout_run(&lanes, kernel, &rng, &board, player,
+                                      BENCH_SAMPLES);
+            double mean = half_points / (2.0 * BENCH_SAMPLES);
+            bool ok = __builtin_fabs(mean - expected) <= tolerance;
+            printf("  %s %.4f%s", playout_kernel_names[k], mean,
+                   ok ? "" : " (OFF)");
+            failed |= !ok;
+        }
+        printf("\n");
+    }
+
+    /* Throughput inside real searches, read back from kxo_mcts_stats */
+    printf("playouts: MCTS searches with mcts_playouts=%d\n", BENCH_PLAYOUTS);
+    set_param("result_cache", "0");
+    set_param("mcts_playouts", "256");
+    memset(table, ' ', N_GRIDS);
+    for (int k = 0; k < NR_PLAYOUT_KERNELS; k++) {
+        char value[4];
+        snprintf(value, sizeof(value), "%d", k + 1);
+        set_param("mcts_playout_kernel", value);
+        for (int r = 0; r < BENCH_REPEATS; r++)
+            mcts(NULL, table, 'O', 0);
+    }
+    set_param("mcts_playouts", "1");
+    mcts_stats_show(stats);
+    for (char *line = strtok(stats, "\n"); line; line = strtok(NULL, "\n"))
+        if (!strncmp(line, "playout_kernel", 14))
+            printf("  %s\n", line);
+    return failed;
+}
+
+int main(int argc, char *argv[])
+{
+    int ret = 0;
+
+    printf("board %dx%d, goal %d, allow_exceed %d\n", BOARD_SIZE, BOARD_SIZE,
+           GOAL, ALLOW_EXCEED);
+    if (negamax_init() || result_cache_init() || mcts_init()) {
+        fprintf(stderr, "engine-bench: out of memory\n");
+        return 1;
+    }
+    /* Single-threaded, reproducible searches that play every move */
+    set_param("mcts_threads", "1");
+    set_param("mcts_seed", "1");
+    set_param("negamax_budget_ns", "0");
+    set_param("negamax_tablebase", "0");
+
+    for (int i = 1; i < argc || (argc == 1 && i == 1); i++) {
+        const char *section = argc > 1 ? argv[i] : NULL;
+        if (!section || !strcmp(section, "moves"))
+            bench_moves();
+        if (!section || !strcmp(section, "cache"))
+            ret |= bench_cache();
+        if (!section || !strcmp(section, "playouts"))
+            ret |= bench_playouts();
+    }
+
+    mcts_free();
+    result_cache_free();
+    negamax_free();
+    return ret;
+}
@@ -0,0 +1,69 @@
+#ifdef __KERNEL__
+#include <linux/kernel.h>
+#include <linux/math64.h>
+#endif
+
+#include "fixed.h"
+
+#ifndef __KERNEL__
+#define U32_MAX UINT32_MAX
+#define div_u64(n, d) ((n) / (d))
+static u64 int_sqrt64(u64 x)
+{
+    u64 r = 0;
+    for (u64 bit = 1ULL << 62; bit; bit >>= 2) {
+        if (x >= r + bit) {
+            x -= r + bit;
+            r = (r >> 1) + bit;
+        } else {
+            r >>= 1;
+        }
+    }
+    return r;
+}
+#endif
+
+u32 uct_log_table[UCT_TABLE_SIZE];
+u32 uct_inv_table[UCT_TABLE_SIZE];
+u32 uct_inv_sqrt_table[UCT_TABLE_SIZE];
+u32 uct_sqrt_table[UCT_SQRT_TABLE_SIZE];
+
+/* log2(x) with 32 fractional bits, by repeated squaring of the mantissa */
+static u64 log2_q32(u32 x)
+{
+    int exp = fls(x) - 1;
+    u64 y = (u64) x << (31 - exp); /* mantissa in [1, 2) with 31 bits */
+    u64 frac = 0;
+    for (int i = 31; i >= 0; i--) {
+        y = (y * y) >> 31;
+        if (y >= (2ULL << 31)) {
+            y >>= 1;
+            frac |= 1ULL << i;
+        }
+    }
+    return ((u64) exp << 32) | frac;
+}
+
+void fixed_init(void)
+{
+    /* ln(2) with 32 fractional bits */
+    const u64 ln2_q32 = 2977044472ULL;
+
+    uct_log_table[0] = 0;
+    uct_inv_table[0] = 0;
+    uct_inv_sqrt_table[0] = 0;
+    for (u32 n = 1; n < UCT_TABLE_SIZE; n++) {
+        u64 log2 = log2_q32(n);
+        /* split to keep the product within 64 bits */
+        u64 ln = (log2 >> 16) * ln2_q32 >> 32;
+        uct_log_table[n] = ln;
+        uct_inv_table[n] = n == 1 ? U32_MAX : div_u64(1ULL << 32, n);
+        uct_inv_sqrt_table[n] = int_sqrt64(div_u64(1ULL << 48, n));
+    }
+
+    for (u32 i = 0; i < UCT_SQRT_TABLE_SIZE; i++) {
+        /* sqrt(i / 256) << UCT_SCALE_BITS */
+        uct_sqrt_table[i] =
+            int_sqrt64((u64) i << (2 * UCT_SCALE_BITS - UCT_SQRT_SAMPLE_BITS));
+    }
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#ifdef __KERNEL__
+#include <linux/bitops.h>
+#include <linux/types.h>
+#else
+/* Userspace builds of the tables, for uct-check.c */
+#include <stdint.h>
+typedef uint32_t u32;
+typedef uint64_t u64;
+static inline int fls(u32 x)
+{
+    return x ? 32 - __builtin_clz(x) : 0;
+}
+#endif
+
+#include "game.h"
+
+/* Table-driven UCT
+ *
+ *   uct(N, n, score) = score / n + C * sqrt(ln(N) / n),  C = sqrt(2)
+ *
+ * where N is the parent visit count, n the child visit count and score the
+ * sum of the child rewards in fixed_point_t. sqrt(ln(N)) is looked up once
+ * per parent, so scoring a child costs two table loads and two multiplies.
+ * Results carry UCT_SCALE_BITS fractional bits and are only meant to be
+ * compared with each other.
+ */
+#define UCT_SCALE_BITS 16
+#define UCT_TABLE_BITS 12
+#define UCT_TABLE_SIZE (1U << UCT_TABLE_BITS)
+
+/* sqrt(ln(x)) is interpolated from samples of ln(x) taken every 1/256 */
+#define UCT_SQRT_SAMPLE_BITS 8
+#define UCT_SQRT_TABLE_SIZE ((23U << UCT_SQRT_SAMPLE_BITS) + 2)
+
+#define UCT_EXPLORATION 92682U /* sqrt(2) << UCT_SCALE_BITS */
+#define UCT_LN2 45426U         /* ln(2) << UCT_SCALE_BITS */
+
+extern u32 uct_log_table[UCT_TABLE_SIZE];
+extern u32 uct_inv_table[UCT_TABLE_SIZE];
+extern u32 uct_inv_sqrt_table[UCT_TABLE_SIZE];
+extern u32 uct_sqrt_table[UCT_SQRT_TABLE_SIZE];
+
+void fixed_init(void);
+
+/* ln(n) << UCT_SCALE_BITS, n >= 1 */
+static inline u32 fixed_log(u32 n)
+{
+    if (n < UCT_TABLE_SIZE)
+        return uct_log_table[n];
+    int shift = fls(n) - UCT_TABLE_BITS;
+    return uct_log_table[n >> shift] + shift * UCT_LN2;
+}
+
+/* C * sqrt(ln(n)) << UCT_SCALE_BITS, the parent part of the UCT bonus */
+static inline u32 uct_parent_factor(u32 n)
+{
+    if (n <= 1)
+        return 0;
+    u32 ln = fixed_log(n);
+    u32 idx = ln >> (UCT_SCALE_BITS - UCT_SQRT_SAMPLE_BITS);
+    u32 frac = ln & ((1U << (UCT_SCALE_BITS - UCT_SQRT_SAMPLE_BITS)) - 1);
+    u32 lo = uct_sqrt_table[idx], hi = uct_sqrt_table[idx + 1];
+    u32 root =
+        lo + (((hi - lo) * frac) >> (UCT_SCALE_BITS - UCT_SQRT_SAMPLE_BITS));
+    return ((u64) root * UCT_EXPLORATION) >> UCT_SCALE_BITS;
+}
+
+static inline u32 uct_value(u32 parent_factor, u32 n, fixed_point_t score)
+{
+    if (n == 0)
+        return FIXED_MAX;
+
+    /* Past the tables, scale n down and the reciprocals back up. Shifting
+     * by an even amount keeps the square root exact, and rounding m halves
+     * the error of the mean.
+     */
+    int shift = 0;
+    u32 m = n;
+    if (n >= UCT_TABLE_SIZE) {
+        shift = (fls(n) - UCT_TABLE_BITS + 1) & ~1;
+        m = (n + (1U << (shift - 1))) >> shift;
+        if (m >= UCT_TABLE_SIZE)
+            m = UCT_TABLE_SIZE - 1;
+    }
+
+    /* uct_inv_table is 2^32 / m, uct_inv_sqrt_table is 2^24 / sqrt(m) */
+    u32 mean = ((u64) score * uct_inv_table[m]) >>
+               (32 - UCT_SCALE_BITS + FIXED_SCALE_BITS + shift);
+    u32 bonus = ((u64) parent_factor * uct_inv_sqrt_table[m]) >>
+                (24 + shift / 2);
+    return mean + bonus;
+}
@@ -1,5 +1,4 @@
 #include "game.h"
-#include <linux/slab.h>
 
 
 const line_t lines[4] = {
@@ -55,14 +54,13 @@ fixed_point_t calculate_win_value(char win, char player)
     return 1U << (FIXED_SCALE_BITS - 1);
 }
 
-int *available_moves(const char *table)
+/* Store the empty grids of @table into @moves, which must have room for
+ * N_GRIDS entries, and return how many were found.
+ */
+int available_moves(const char *table, int *moves)
 {
-    int *moves = kzalloc(N_GRIDS * sizeof(int), GFP_KERNEL);
     int m = 0;
-    for (int i = 0; i < N_GRIDS; i++)
-        if (table[i] == ' ')
-            moves[m++] = i;
-    if (m < N_GRIDS)
-        moves[m] = -1;
-    return moves;
+    for_each_empty_grid(i, table)
+        moves[m++] = i;
+    return m;
 }
@@ -1,12 +1,23 @@
 #pragma once
 
+/* Overridden from the command line, e.g. make BOARD_SIZE=5 GOAL=4 */
+#ifndef BOARD_SIZE
 #define BOARD_SIZE 4
+#endif
+#ifndef GOAL
 #define GOAL 3
+#endif
+#ifndef ALLOW_EXCEED
 #define ALLOW_EXCEED 1
+#endif
 #define N_GRIDS (BOARD_SIZE * BOARD_SIZE)
 #define GET_INDEX(i, j) ((i) * (BOARD_SIZE) + (j))
 #define GET_COL(x) ((x) % BOARD_SIZE)
 #define GET_ROW(x) ((x) / BOARD_SIZE)
+#define LOOKUP(table, i, j, else_value)                           \
+    ((i) < 0 || (j) < 0 || (i) >= BOARD_SIZE || (j) >= BOARD_SIZE \
+         ? (else_value)                                           \
+         : (table)[GET_INDEX(i, j)])
 
 #define for_each_empty_grid(i, table) \
     for (int i = 0; i < N_GRIDS; i++) \
@@ -28,15 +39,14 @@ typedef struct {
 typedef unsigned fixed_point_t;
 
 #define DRAW_SIZE (N_GRIDS + BOARD_SIZE)
-#define DRAWBUFFER_SIZE                                                 \
-    ((BOARD_SIZE * (BOARD_SIZE + 1) << 1) + (BOARD_SIZE * BOARD_SIZE) + \
-     (BOARD_SIZE << 1) + 1)
+/* Every row of the board and the line below it take 4 * BOARD_SIZE bytes */
+#define DRAWBUFFER_SIZE (4 * BOARD_SIZE * BOARD_SIZE + 1)
 
 #define READ_DATA_SIZE 2
 
 extern const line_t lines[4];
 
-int *available_moves(const char *table);
+int available_moves(const char *table, int *moves);
 char check_win(const char *t);
 fixed_point_t calculate_win_value(char win, char player);
 
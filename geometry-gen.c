@@ -0,0 +1,178 @@
+/* Print geometry.h, the board tables of the configured BOARD_SIZE, GOAL and
+ * ALLOW_EXCEED as constant arrays, so that the engines compile against the
+ * actual segments instead of filling the tables at load time.
+ */
+#include <stdint.h>
+#include <stdio.h>
+
+#include "game.h"
+
+#define N_SYMMETRIES 8
+#define MAX_SEGMENTS 256
+
+static uint64_t masks[MAX_SEGMENTS], ends[MAX_SEGMENTS];
+static int cells[MAX_SEGMENTS][GOAL], end_cells[MAX_SEGMENTS][2];
+static int n_segments;
+
+static int on_board(int i, int j)
+{
+    return i >= 0 && j >= 0 && i < BOARD_SIZE && j < BOARD_SIZE;
+}
+
+/* Walk lines[] in the same order as check_win() so that both report the same
+ * winner for the same position.
+ */
+static void collect_segments(void)
+{
+    for (int i_line = 0; i_line < 4; ++i_line) {
+        line_t line = lines[i_line];
+        for (int i = line.i_lower_bound; i < line.i_upper_bound; ++i) {
+            for (int j = line.j_lower_bound; j < line.j_upper_bound; ++j) {
+                uint64_t mask = 0, end = 0;
+                for (int k = 0; k < GOAL; k++) {
+                    int cell = GET_INDEX(i + k * line.i_shift,
+                                         j + k * line.j_shift);
+                    mask |= 1ULL << cell;
+                    cells[n_segments][k] = cell;
+                }
+                /* The grids that would make the line longer than GOAL */
+                int bi = i - line.i_shift, bj = j - line.j_shift;
+                int ai = i + GOAL * line.i_shift, aj = j + GOAL * line.j_shift;
+                end_cells[n_segments][0] = end_cells[n_segments][1] = N_GRIDS;
+                if (on_board(bi, bj)) {
+                    end |= 1ULL << GET_INDEX(bi, bj);
+                    end_cells[n_segments][0] = GET_INDEX(bi, bj);
+                }
+                if (on_board(ai, aj)) {
+                    end |= 1ULL << GET_INDEX(ai, aj);
+                    end_cells[n_segments][1] = GET_INDEX(ai, aj);
+                }
+                masks[n_segments] = mask;
+                ends[n_segments++] = end;
+            }
+        }
+    }
+}
+
+/* Bit 0 mirrors the columns, bit 1 the rows, bit 2 transposes */
+static int sym_cell(int s, int cell)
+{
+    int row = GET_ROW(cell), col = GET_COL(cell);
+    if (s & 1)
+        col = BOARD_SIZE - 1 - col;
+    if (s & 2)
+        row = BOARD_SIZE - 1 - row;
+    return s & 4 ? GET_INDEX(col, row) : GET_INDEX(row, col);
+}
+
+static void print_masks(const char *name, const uint64_t *v)
+{
+    printf("static const bitboard_t %s[N_LINE_SEGMENTS] = {\n", name);
+    for (int i = 0; i < n_segments; i++)
+        printf("%s0x%llx,%s", i % 4 ? " " : "    ", (unsigned long long) v[i],
+               i % 4 == 3 || i == n_segments - 1 ? "\n" : "");
+    printf("};\n\n");
+}
+
+/* On one line in braces, or with @indent, 12 to a line */
+static void print_row(const int *v, int n, const char *indent)
+{
+    if (!indent) {
+        printf("{");
+        for (int i = 0; i < n; i++)
+            printf("%s%d", i ? ", " : "", v[i]);
+        printf("}");
+        return;
+    }
+    for (int i = 0; i < n; i++)
+        printf("%s%d,%s", i % 12 ? " " : indent, v[i],
+               i % 12 == 11 || i == n - 1 ? "\n" : "");
+}
+
+int main(void)
+{
+    int row[N_GRIDS > MAX_SEGMENTS ? N_GRIDS : MAX_SEGMENTS];
+
+    collect_segments();
+    printf("/* Generated by geometry-gen for a %dx%d board, GOAL %d, "
+           "ALLOW_EXCEED %d */\n#pragma once\n\n",
+           BOARD_SIZE, BOARD_SIZE, GOAL, ALLOW_EXCEED);
+    printf("#if BOARD_SIZE != %d || GOAL != %d || ALLOW_EXCEED != %d\n"
+           "#error \"geometry.h is for another board, run make again\"\n"
+           "#endif\n\n",
+           BOARD_SIZE, GOAL, ALLOW_EXCEED);
+
+    print_masks("line_masks", masks);
+    print_masks("line_ends", ends);
+
+    printf("static const u8 line_cells[N_LINE_SEGMENTS][GOAL] = {\n");
+    for (int i = 0; i < n_segments; i++) {
+        printf("    ");
+        print_row(cells[i], GOAL, NULL);
+        printf(",\n");
+    }
+    printf("};\n\n");
+
+    printf("static const u8 line_end_cells[N_LINE_SEGMENTS][2] = {\n");
+    for (int i = 0; i < n_segments; i++) {
+        printf("    ");
+        print_row(end_cells[i], 2, NULL);
+        printf(",\n");
+    }
+    printf("};\n\n");
+
+    /* eval_line_segment_score(): k pieces of one side score 10^(k-1) */
+    int weights[GOAL + 1] = {0, 1};
+    for (int k = 2; k <= GOAL; k++)
+        weights[k] = weights[k - 1] * 10;
+    printf("static const int line_weights[GOAL + 1] = ");
+    print_row(weights, GOAL + 1, NULL);
+    printf(";\n\n");
+
+    /* A segment both sides have a piece on is dead */
+    printf("static const int segment_scores[GOAL + 1][GOAL + 1] = {\n");
+    for (int o = 0; o <= GOAL; o++) {
+        for (int x = 0; x <= GOAL; x++)
+            row[x] = o && x ? 0 : weights[o] - weights[x];
+        printf("    ");
+        print_row(row, GOAL + 1, NULL);
+        printf(",\n");
+    }
+    printf("};\n\n");
+
+    printf("static const u8 cell_lines[N_GRIDS][MAX_CELL_LINES] = {\n");
+    int nr_lines[N_GRIDS];
+    for (int cell = 0; cell < N_GRIDS; cell++) {
+        nr_lines[cell] = 0;
+        for (int i = 0; i < n_segments; i++)
+            if (masks[i] >> cell & 1)
+                row[nr_lines[cell]++] = i;
+        printf("    ");
+        print_row(row, nr_lines[cell], NULL);
+        printf(",\n");
+    }
+    printf("};\n\n");
+
+    printf("static const u8 cell_nr_lines[N_GRIDS] = {\n");
+    print_row(nr_lines, N_GRIDS, "    ");
+    printf("};\n\n");
+
+    const char *names[] = {"sym_cells", "sym_inverse"};
+    for (int inverse = 0; inverse < 2; inverse++) {
+        printf("static const u8 %s[N_SYMMETRIES][N_GRIDS] = {\n",
+               names[inverse]);
+        for (int s = 0; s < N_SYMMETRIES; s++) {
+            for (int cell = 0; cell < N_GRIDS; cell++) {
+                if (inverse)
+                    row[sym_cell(s, cell)] = cell;
+                else
+                    row[cell] = sym_cell(s, cell);
+            }
+            printf("    {\n");
+            print_row(row, N_GRIDS, "        ");
+            printf("    },\n");
+        }
+        printf("};\n%s", inverse ? "" : "\n");
+    }
+    return 0;
+}
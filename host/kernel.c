@@ -0,0 +1,237 @@
+/* Out-of-line parts of host/kernel.h: module parameters, work items and
+ * kthreads on pthreads, completions, and firmware read from files.
+ */
+#include <pthread.h>
+#include <unistd.h>
+
+#include "kernel.h"
+
+#define HOST_MAX_PARAMS 64
+
+static struct {
+    const char *name;
+    void *var;
+    enum host_param_type type;
+    size_t n;
+} params[HOST_MAX_PARAMS];
+static int nr_params;
+
+void host_param_register(const char *name,
+                         void *var,
+                         enum host_param_type type,
+                         size_t n)
+{
+    if (nr_params == HOST_MAX_PARAMS) {
+        fprintf(stderr, "host: too many module parameters\n");
+        exit(1);
+    }
+    params[nr_params].name = name;
+    params[nr_params].var = var;
+    params[nr_params].type = type;
+    params[nr_params++].n = n;
+}
+
+/* Returns 0, or -EINVAL for an unknown parameter */
+int host_param_set(const char *name, const char *value)
+{
+    for (int i = 0; i < nr_params; i++) {
+        if (strcmp(params[i].name, name))
+            continue;
+        switch (params[i].type) {
+        case HOST_PARAM_uint:
+            *(unsigned int *) params[i].var = strtoul(value, NULL, 0);
+            break;
+        case HOST_PARAM_ulong:
+            *(unsigned long *) params[i].var = strtoul(value, NULL, 0);
+            break;
+        case HOST_PARAM_bool:
+            *(bool *) params[i].var = strchr("1yY", value[0]) != NULL;
+            break;
+        case HOST_PARAM_charp:
+            *(const char **) params[i].var = value;
+            break;
+        case HOST_PARAM_array_uint: {
+            /* Like the kernel, entries past the list keep their value */
+            unsigned int *array = params[i].var;
+            const char *p = value;
+            for (size_t k = 0; k < params[i].n && *p; k++) {
+                char *end;
+                array[k] = strtoul(p, &end, 0);
+                p = *end == ',' ? end + 1 : end;
+            }
+            break;
+        }
+        }
+        return 0;
+    }
+    return -EINVAL;
+}
+
+unsigned int num_online_cpus(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? n : 1;
+}
+
+struct workqueue_struct *alloc_workqueue(const char *name __always_unused,
+                                         unsigned int flags __always_unused,
+                                         int max_active __always_unused)
+{
+    static int wq;
+    return (struct workqueue_struct *) &wq;
+}
+
+void destroy_workqueue(struct workqueue_struct *wq __always_unused) {}
+
+static void *work_thread(void *data)
+{
+    struct work_struct *work = data;
+    work->func(work);
+    return NULL;
+}
+
+bool queue_work(struct workqueue_struct *wq __always_unused,
+                struct work_struct *work)
+{
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, work_thread, work)) {
+        work->thread = 0;
+        work->func(work);
+        return true;
+    }
+    work->thread = thread;
+    return true;
+}
+
+bool flush_work(struct work_struct *work)
+{
+    if (work->thread)
+        pthread_join((pthread_t) work->thread, NULL);
+    work->thread = 0;
+    return true;
+}
+
+struct task_struct {
+    pthread_t thread;
+    int (*fn)(void *data);
+    void *data;
+    bool should_stop;
+};
+
+static __thread struct task_struct *current_task;
+static pthread_mutex_t sched_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sched_wake = PTHREAD_COND_INITIALIZER;
+
+static void *kthread_func(void *data)
+{
+    current_task = data;
+    current_task->fn(current_task->data);
+    return NULL;
+}
+
+struct task_struct *kthread_run(int (*fn)(void *data),
+                                void *data,
+                                const char *fmt __always_unused,
+                                ...)
+{
+    struct task_struct *task = calloc(1, sizeof(*task));
+    if (!task)
+        return (struct task_struct *) (long) -ENOMEM;
+    task->fn = fn;
+    task->data = data;
+    if (pthread_create(&task->thread, NULL, kthread_func, task)) {
+        free(task);
+        return (struct task_struct *) (long) -EAGAIN;
+    }
+    return task;
+}
+
+bool kthread_should_stop(void)
+{
+    return current_task && __atomic_load_n(&current_task->should_stop,
+                                           __ATOMIC_ACQUIRE);
+}
+
+int kthread_stop(struct task_struct *task)
+{
+    __atomic_store_n(&task->should_stop, true, __ATOMIC_RELEASE);
+    wake_up_process(task);
+    pthread_join(task->thread, NULL);
+    free(task);
+    return 0;
+}
+
+/* set_current_state() does nothing here, so a sleep is bounded instead:
+ * a wakeup sent before it is missed for one millisecond at most.
+ */
+void schedule(void)
+{
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_nsec += 1000000;
+    if (until.tv_nsec >= 1000000000) {
+        until.tv_sec++;
+        until.tv_nsec -= 1000000000;
+    }
+    pthread_mutex_lock(&sched_lock);
+    pthread_cond_timedwait(&sched_wake, &sched_lock, &until);
+    pthread_mutex_unlock(&sched_lock);
+}
+
+int wake_up_process(struct task_struct *task __always_unused)
+{
+    pthread_mutex_lock(&sched_lock);
+    pthread_cond_broadcast(&sched_wake);
+    pthread_mutex_unlock(&sched_lock);
+    return 1;
+}
+
+void complete(struct completion *c)
+{
+    pthread_mutex_lock(&sched_lock);
+    c->done++;
+    pthread_cond_broadcast(&sched_wake);
+    pthread_mutex_unlock(&sched_lock);
+}
+
+void wait_for_completion(struct completion *c)
+{
+    pthread_mutex_lock(&sched_lock);
+    while (!c->done)
+        pthread_cond_wait(&sched_wake, &sched_lock);
+    c->done--;
+    pthread_mutex_unlock(&sched_lock);
+}
+
+int request_firmware(const struct firmware **fw,
+                     const char *name,
+                     struct device *dev __always_unused)
+{
+    FILE *f = fopen(name, "rb");
+    if (!f)
+        return -ENOENT;
+    struct firmware *file = calloc(1, sizeof(*file));
+    u8 *data = NULL;
+    if (file && !fseek(f, 0, SEEK_END)) {
+        long size = ftell(f);
+        data = size > 0 ? malloc(size) : NULL;
+        rewind(f);
+        if (data && fread(data, 1, size, f) == (size_t) size) {
+            file->size = size;
+            file->data = data;
+            fclose(f);
+            *fw = file;
+            return 0;
+        }
+    }
+    free(data);
+    free(file);
+    fclose(f);
+    return -EIO;
+}
+
+void release_firmware(const struct firmware *fw)
+{
+    free((void *) fw->data);
+    free((void *) fw);
+}
@@ -0,0 +1,366 @@
+#pragma once
+
+/* Userspace stand-ins for the kernel interfaces the engines use, so that
+ * engine-bench can build mcts.c, negamax.c and their helpers unchanged. Every
+ * <linux/...> and <asm/...> header the engines include is a file under host/
+ * that only includes this one. Module parameters are registered by name and
+ * set with host_param_set(), like writing /sys/module/kxo/parameters/.
+ */
+#include <errno.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+
+#ifdef __x86_64__
+#define CONFIG_X86_64 1
+#endif
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef unsigned long long u64;
+typedef int8_t s8;
+typedef int16_t s16;
+typedef int32_t s32;
+typedef long long s64;
+typedef unsigned __int128 u128;
+
+#define U32_MAX UINT32_MAX
+#define S64_MAX INT64_MAX
+
+/* compiler.h */
+#define __aligned(x) __attribute__((aligned(x)))
+#define __always_unused __attribute__((unused))
+#define __rcu
+#define likely(x) __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+#define READ_ONCE(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define WRITE_ONCE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+#define smp_load_acquire(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define smp_store_release(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define BUILD_BUG_ON(cond) _Static_assert(!(cond), #cond)
+#define container_of(ptr, type, member) \
+    ((type *) ((char *) (ptr) - offsetof(type, member)))
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+/* minmax.h and kernel.h */
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define min_t(t, a, b) min((t) (a), (t) (b))
+#define max_t(t, a, b) max((t) (a), (t) (b))
+#define clamp_t(t, v, lo, hi) min_t(t, max_t(t, v, lo), hi)
+#define swap(a, b)              \
+    do {                        \
+        __typeof__(a) __t = a;  \
+        a = b;                  \
+        b = __t;                \
+    } while (0)
+#define DIV_ROUND_UP(n, d) (((n) + (d) - 1) / (d))
+#define ALIGN(x, a) (((x) + (a) - 1) & ~((__typeof__(x)) (a) - 1))
+#define BIT_ULL(n) (1ULL << (n))
+#define struct_size(p, member, n) \
+    (sizeof(*(p)) + sizeof((p)->member[0]) * (size_t) (n))
+
+static inline u32 reciprocal_scale(u32 val, u32 ep_ro)
+{
+    return (u32) (((u64) val * ep_ro) >> 32);
+}
+
+static inline u64 int_sqrt64(u64 x)
+{
+    u64 r = 0;
+    for (u64 bit = 1ULL << 62; bit; bit >>= 2) {
+        if (x >= r + bit) {
+            x -= r + bit;
+            r = (r >> 1) + bit;
+        } else {
+            r >>= 1;
+        }
+    }
+    return r;
+}
+
+/* math64.h */
+#define div_u64(n, d) ((u64) (n) / (u32) (d))
+#define div64_u64(n, d) ((u64) (n) / (u64) (d))
+#define div64_s64(n, d) ((s64) (n) / (s64) (d))
+
+/* bitops.h and log2.h */
+#define hweight16(x) __builtin_popcount((u16) (x))
+#define hweight32(x) __builtin_popcount((u32) (x))
+#define hweight64(x) __builtin_popcountll((u64) (x))
+#define __ffs64(x) __builtin_ctzll((u64) (x))
+
+static inline int fls(u32 x)
+{
+    return x ? 32 - __builtin_clz(x) : 0;
+}
+
+static inline unsigned long roundup_pow_of_two(unsigned long n)
+{
+    return n <= 1 ? 1 : 1UL << (64 - __builtin_clzl(n - 1));
+}
+
+static inline unsigned long rounddown_pow_of_two(unsigned long n)
+{
+    return 1UL << (63 - __builtin_clzl(n));
+}
+
+static inline bool test_and_clear_bit(long nr, unsigned long *addr)
+{
+    unsigned long mask = 1UL << nr;
+    return __atomic_fetch_and(addr, ~mask, __ATOMIC_SEQ_CST) & mask;
+}
+
+static inline void set_bit(long nr, unsigned long *addr)
+{
+    __atomic_fetch_or(addr, 1UL << nr, __ATOMIC_SEQ_CST);
+}
+
+/* hash.h */
+#define GOLDEN_RATIO_64 0x61C8864680B583EBull
+
+/* atomic.h */
+typedef struct {
+    int counter;
+} atomic_t;
+typedef struct {
+    long counter;
+} atomic_long_t;
+typedef struct {
+    s64 counter;
+} atomic64_t;
+
+#define ATOMIC_INIT(i) {(i)}
+#define __HOST_ATOMIC(prefix, type)                                          \
+    static inline type prefix##_read(const prefix##_t *v)                    \
+    {                                                                        \
+        return __atomic_load_n(&v->counter, __ATOMIC_RELAXED);               \
+    }                                                                        \
+    static inline void prefix##_set(prefix##_t *v, type i)                   \
+    {                                                                        \
+        __atomic_store_n(&v->counter, i, __ATOMIC_RELAXED);                  \
+    }                                                                        \
+    static inline void prefix##_add(type i, prefix##_t *v)                   \
+    {                                                                        \
+        __atomic_fetch_add(&v->counter, i, __ATOMIC_RELAXED);                \
+    }                                                                        \
+    static inline void prefix##_sub(type i, prefix##_t *v)                   \
+    {                                                                        \
+        __atomic_fetch_sub(&v->counter, i, __ATOMIC_RELAXED);                \
+    }                                                                        \
+    static inline void prefix##_inc(prefix##_t *v)                           \
+    {                                                                        \
+        prefix##_add(1, v);                                                  \
+    }                                                                        \
+    static inline type prefix##_add_return(type i, prefix##_t *v)            \
+    {                                                                        \
+        return __atomic_add_fetch(&v->counter, i, __ATOMIC_SEQ_CST);         \
+    }                                                                        \
+    static inline type prefix##_inc_return(prefix##_t *v)                    \
+    {                                                                        \
+        return prefix##_add_return(1, v);                                    \
+    }                                                                        \
+    static inline type prefix##_cmpxchg(prefix##_t *v, type old, type new)   \
+    {                                                                        \
+        __atomic_compare_exchange_n(&v->counter, &old, new, false,           \
+                                    __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);     \
+        return old;                                                          \
+    }                                                                        \
+    static inline bool prefix##_try_cmpxchg(prefix##_t *v, type *old,        \
+                                            type new)                        \
+    {                                                                        \
+        return __atomic_compare_exchange_n(&v->counter, old, new, false,     \
+                                           __ATOMIC_SEQ_CST,                 \
+                                           __ATOMIC_SEQ_CST);                \
+    }
+__HOST_ATOMIC(atomic, int)
+__HOST_ATOMIC(atomic_long, long)
+__HOST_ATOMIC(atomic64, s64)
+
+#define cmpxchg(ptr, old, new) __sync_val_compare_and_swap(ptr, old, new)
+
+/* spinlock.h */
+typedef struct {
+    int locked;
+} spinlock_t;
+#define DEFINE_SPINLOCK(x) spinlock_t x = {0}
+#define spin_lock_init(l) ((l)->locked = 0)
+
+static inline void spin_lock(spinlock_t *l)
+{
+    while (__atomic_exchange_n(&l->locked, 1, __ATOMIC_ACQUIRE))
+        ;
+}
+
+static inline void spin_unlock(spinlock_t *l)
+{
+    __atomic_store_n(&l->locked, 0, __ATOMIC_RELEASE);
+}
+
+/* rcupdate.h: evicted entries are never freed, so readers need no lock */
+#define rcu_read_lock() ((void) 0)
+#define rcu_read_unlock() ((void) 0)
+#define rcu_dereference(p) __atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+#define rcu_dereference_protected(p, c) (p)
+#define rcu_assign_pointer(p, v) __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+#define lockdep_is_held(l) 1
+struct rcu_head {
+    void *next;
+};
+#define kfree_rcu(p, field) ((void) (p))
+
+/* percpu.h: one set of counters, updated atomically */
+#define DEFINE_PER_CPU(type, name) type name
+#define this_cpu_inc(x) __atomic_fetch_add(&(x), 1, __ATOMIC_RELAXED)
+#define per_cpu_ptr(p, cpu) (p)
+#define for_each_possible_cpu(cpu) for ((cpu) = 0; (cpu) < 1; (cpu)++)
+
+/* slab.h and vmalloc.h */
+#define GFP_KERNEL 0
+#define kmalloc(size, gfp) malloc(size)
+#define kvmalloc(size, gfp) malloc(size)
+#define vmalloc(size) malloc(size)
+#define kzalloc(size, gfp) calloc(1, size)
+#define kvzalloc(size, gfp) calloc(1, size)
+#define kcalloc(n, size, gfp) calloc(n, size)
+#define kvcalloc(n, size, gfp) calloc(n, size)
+#define kfree(p) free((void *) (p))
+#define kvfree(p) free((void *) (p))
+#define vfree(p) free((void *) (p))
+
+/* printk.h and bug.h */
+#define KERN_ERR
+#define pr_info(...) ((void) 0)
+#define pr_warn(...) fprintf(stderr, __VA_ARGS__)
+#define printk(...) fprintf(stderr, __VA_ARGS__)
+#define WARN_ONCE(cond, ...)                 \
+    ({                                       \
+        static bool __warned;                \
+        bool __c = !!(cond);                 \
+        if (__c && !__warned) {              \
+            __warned = true;                 \
+            fprintf(stderr, __VA_ARGS__);    \
+        }                                    \
+        __c;                                 \
+    })
+
+/* err.h */
+#define IS_ERR(p) ((unsigned long) (p) >= (unsigned long) -4095)
+
+/* ktime.h */
+typedef s64 ktime_t;
+#define NSEC_PER_USEC 1000L
+#define NSEC_PER_MSEC 1000000L
+#define USEC_PER_SEC 1000000L
+#define ktime_to_ns(t) (t)
+#define ktime_sub(a, b) ((a) - (b))
+
+static inline ktime_t ktime_get(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (s64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+#define ktime_get_ns() ((u64) ktime_get())
+
+/* sysfs.h, buffers are a page */
+#define PAGE_SIZE 4096
+#define sysfs_emit(buf, ...) snprintf(buf, PAGE_SIZE, __VA_ARGS__)
+#define sysfs_emit_at(buf, at, ...) \
+    snprintf((buf) + (at), PAGE_SIZE - (at), __VA_ARGS__)
+
+/* cpumask.h */
+unsigned int num_online_cpus(void);
+
+/* moduleparam.h */
+enum host_param_type {
+    HOST_PARAM_uint,
+    HOST_PARAM_ulong,
+    HOST_PARAM_bool,
+    HOST_PARAM_charp,
+    HOST_PARAM_array_uint,
+};
+void host_param_register(const char *name,
+                         void *var,
+                         enum host_param_type type,
+                         size_t n);
+int host_param_set(const char *name, const char *value);
+
+#define module_param(name, type, perm)                                  \
+    static void __attribute__((constructor)) __host_param_##name(void) \
+    {                                                                   \
+        host_param_register(#name, &name, HOST_PARAM_##type, 1);        \
+    }
+#define module_param_array(name, type, nump, perm)                         \
+    static void __attribute__((constructor)) __host_param_##name(void)    \
+    {                                                                      \
+        host_param_register(#name, name, HOST_PARAM_array_##type,          \
+                            ARRAY_SIZE(name));                             \
+    }
+#define MODULE_PARM_DESC(name, desc)
+
+/* workqueue.h: every queued work runs on a thread of its own */
+struct work_struct {
+    void (*func)(struct work_struct *work);
+    unsigned long thread;
+};
+struct workqueue_struct;
+#define WQ_UNBOUND 0
+#define INIT_WORK(w, f) ((w)->func = (f))
+struct workqueue_struct *alloc_workqueue(const char *name,
+                                         unsigned int flags,
+                                         int max_active);
+void destroy_workqueue(struct workqueue_struct *wq);
+bool queue_work(struct workqueue_struct *wq, struct work_struct *work);
+bool flush_work(struct work_struct *work);
+
+/* kthread.h and sched.h */
+struct task_struct;
+#define TASK_RUNNING 0
+#define TASK_INTERRUPTIBLE 1
+struct task_struct *kthread_run(int (*fn)(void *data),
+                                void *data,
+                                const char *fmt,
+                                ...);
+int kthread_stop(struct task_struct *task);
+bool kthread_should_stop(void);
+void schedule(void);
+int wake_up_process(struct task_struct *task);
+#define set_current_state(state) ((void) 0)
+#define __set_current_state(state) ((void) 0)
+
+/* completion.h */
+struct completion {
+    unsigned int done;
+};
+#define init_completion(c) ((c)->done = 0)
+#define reinit_completion(c) ((c)->done = 0)
+void complete(struct completion *c);
+void wait_for_completion(struct completion *c);
+
+/* device.h and firmware.h: firmware files are read from the current
+ * directory
+ */
+struct device;
+struct firmware {
+    size_t size;
+    const u8 *data;
+};
+int request_firmware(const struct firmware **fw,
+                     const char *name,
+                     struct device *dev);
+void release_firmware(const struct firmware *fw);
+
+/* asm/cpufeature.h and asm/fpu/api.h */
+#define X86_FEATURE_AVX2 "avx2"
+#define boot_cpu_has(feature) __builtin_cpu_supports(feature)
+#define kernel_fpu_begin() ((void) 0)
+#define kernel_fpu_end() ((void) 0)
@@ -13,17 +13,22 @@
 #include <linux/workqueue.h>
 
 
+#include "cpu_budget.h"
 #include "game.h"
 #include "mcts.h"
 #include "negamax.h"
+#include "result_cache.h"
+#include "tablebase.h"
 #include "zobrist.h"
 
 #include "gamecount.h"
 #include "load.h"
 
 static struct game games[MAX_GAMES];
+static struct mcts_tree *mcts_trees[MAX_GAMES];
 static unsigned char check_won[MAX_GAMES];
 static atomic_t won_count;
+atomic_t kxo_busy_cpus = ATOMIC_INIT(0);
 
 struct ai_work {
     struct work_struct work;
@@ -98,6 +103,42 @@ static ssize_t kxo_state_store(struct device *dev,
 
 static DEVICE_ATTR_RW(kxo_state);
 
+static ssize_t kxo_mcts_stats_show(struct device *dev,
+                                   struct device_attribute *attr,
+                                   char *buf)
+{
+    return mcts_stats_show(buf);
+}
+
+static DEVICE_ATTR_RO(kxo_mcts_stats);
+
+static ssize_t kxo_tt_stats_show(struct device *dev,
+                                 struct device_attribute *attr,
+                                 char *buf)
+{
+    return zobrist_stats_show(buf);
+}
+
+static DEVICE_ATTR_RO(kxo_tt_stats);
+
+static ssize_t kxo_negamax_stats_show(struct device *dev,
+                                      struct device_attribute *attr,
+                                      char *buf)
+{
+    return negamax_stats_show(buf);
+}
+
+static DEVICE_ATTR_RO(kxo_negamax_stats);
+
+static ssize_t kxo_cache_stats_show(struct device *dev,
+                                    struct device_attribute *attr,
+                                    char *buf)
+{
+    return result_cache_stats_show(buf);
+}
+
+static DEVICE_ATTR_RO(kxo_cache_stats);
+
 /* Data produced by the simulated device */
 
 /* Timer to simulate a periodic IRQ */
@@ -193,6 +234,15 @@ static void drawboard_work_func(struct game *g)
     wake_up_interruptible(&rx_wait);
 }
 
+/* Called with the game lock held. The tree kept for the next MCTS move would
+ * hold its share of mcts_max_total_nodes until the game is played again.
+ */
+static void game_over(struct game *g)
+{
+    WRITE_ONCE(check_won[g->id], 1);
+    atomic_inc(&won_count);
+    mcts_tree_release(mcts_trees[g->id]);
+}
 
 // MCTS algo is 'O'
 static void ai_one_work_func(struct work_struct *w)
@@ -205,8 +255,12 @@ static void ai_one_work_func(struct work_struct *w)
     WARN_ON_ONCE(in_softirq());
     WARN_ON_ONCE(in_interrupt());
 
+    /* The search may sleep (allocation, waiting for helper workers), so
+     * only pin the CPU while reporting it.
+     */
     cpu = get_cpu();
     pr_info("kxo: [CPU#%d] start doing %s\n", cpu, __func__);
+    put_cpu();
     tv_start = ktime_get();
 
     struct ai_work *work = container_of(w, struct ai_work, work);
@@ -218,7 +272,7 @@ static void ai_one_work_func(struct work_struct *w)
         goto exit;
 
     int move;
-    WRITE_ONCE(move, mcts(g->table, 'O'));
+    WRITE_ONCE(move, mcts(mcts_trees[g->id], g->table, 'O', g->id));
 
     smp_mb();
 
@@ -231,10 +285,8 @@ static void ai_one_work_func(struct work_struct *w)
     WRITE_ONCE(g->finish, 1);
     smp_wmb();
 
-    if (check_win(g->table) != ' ') {
-        WRITE_ONCE(check_won[g->id], 1);
-        atomic_inc(&won_count);
-    }
+    if (check_win(g->table) != ' ')
+        game_over(g);
 
     smp_wmb();
     drawboard_work_func(g);
@@ -249,7 +301,6 @@ exit:
 
     pr_info("kxo: [CPU#%d] did %s for %llu usec(game %u)\n", cpu, __func__,
             (unsigned long long) nsecs >> 10, g->id + 1);
-    put_cpu();
 }
 
 // negamax algo is 'X'
@@ -265,6 +316,7 @@ static void ai_two_work_func(struct work_struct *w)
 
     cpu = get_cpu();
     pr_info("kxo: [CPU#%d] start doing %s\n", cpu, __func__);
+    put_cpu();
     tv_start = ktime_get();
 
     struct ai_work *work = container_of(w, struct ai_work, work);
@@ -289,10 +341,8 @@ static void ai_two_work_func(struct work_struct *w)
     WRITE_ONCE(g->finish, 1);
     smp_wmb();
 
-    if (check_win(g->table) != ' ') {
-        WRITE_ONCE(check_won[g->id], 1);
-        atomic_inc(&won_count);
-    }
+    if (check_win(g->table) != ' ')
+        game_over(g);
 
     smp_wmb();
     drawboard_work_func(g);
@@ -308,7 +358,6 @@ exit:
 
     pr_info("kxo: [CPU#%d] did %s for %llu usec\n", cpu, __func__,
             (unsigned long long) nsecs >> 10);
-    put_cpu();
 }
 
 
@@ -583,6 +632,30 @@ static int __init kxo_init(void)
         goto error_device;
     }
 
+    ret = device_create_file(kxo_dev, &dev_attr_kxo_mcts_stats);
+    if (ret < 0) {
+        printk(KERN_ERR "failed to create sysfs file kxo_mcts_stats\n");
+        goto error_device;
+    }
+
+    ret = device_create_file(kxo_dev, &dev_attr_kxo_tt_stats);
+    if (ret < 0) {
+        printk(KERN_ERR "failed to create sysfs file kxo_tt_stats\n");
+        goto error_device;
+    }
+
+    ret = device_create_file(kxo_dev, &dev_attr_kxo_negamax_stats);
+    if (ret < 0) {
+        printk(KERN_ERR "failed to create sysfs file kxo_negamax_stats\n");
+        goto error_device;
+    }
+
+    ret = device_create_file(kxo_dev, &dev_attr_kxo_cache_stats);
+    if (ret < 0) {
+        printk(KERN_ERR "failed to create sysfs file kxo_cache_stats\n");
+        goto error_device;
+    }
+
     /* Allocate fast circular buffer */
     fast_buf.buf = vmalloc(PAGE_SIZE);
     if (!fast_buf.buf) {
@@ -596,8 +669,16 @@ static int __init kxo_init(void)
         ret = -ENOMEM;
         goto error_workqueue;
     }
-    negamax_init();
-    mcts_init();
+    ret = negamax_init();
+    if (ret)
+        goto error_negamax;
+    tablebase_load(kxo_dev);
+    ret = result_cache_init();
+    if (ret)
+        goto error_cache;
+    ret = mcts_init();
+    if (ret)
+        goto error_mcts;
 
     // initialize every game
     for (int i = 0; i < MAX_GAMES; i++) {
@@ -607,6 +688,9 @@ static int __init kxo_init(void)
         games[i] = (struct game){.id = i, .turn = 'O', .finish = 1};
         memset(games[i].table, ' ', N_GRIDS);
 
+        /* Without a tree the game still plays, searching from scratch */
+        mcts_trees[i] = mcts_tree_alloc();
+
         INIT_WORK(&ai_one_works[i].work, ai_one_work_func);
         ai_one_works[i].game = &games[i];
 
@@ -627,6 +711,13 @@ static int __init kxo_init(void)
     pr_info("kxo: registered new kxo device: %d,%d\n", major, 0);
 out:
     return ret;
+error_mcts:
+    result_cache_free();
+error_cache:
+    tablebase_free();
+    negamax_free();
+error_negamax:
+    destroy_workqueue(kxo_workqueue);
 error_workqueue:
     vfree(fast_buf.buf);
 error_vmalloc:
@@ -655,7 +746,12 @@ static void __exit kxo_exit(void)
     cdev_del(&kxo_cdev);
     unregister_chrdev_region(dev_id, NR_KMLDRV);
 
-    zobrist_free();
+    result_cache_free();
+    tablebase_free();
+    negamax_free();
+    for (int i = 0; i < MAX_GAMES; i++)
+        mcts_tree_free(mcts_trees[i]);
+    mcts_free();
 
     kfifo_free(&rx_fifo);
     pr_info("kxo: unloaded\n");
@@ -1,218 +1,1239 @@
+#include <linux/hash.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+#include <linux/moduleparam.h>
+#include <linux/overflow.h>
 #include <linux/slab.h>
+#include <linux/spinlock.h>
 #include <linux/string.h>
+#include <linux/sysfs.h>
+#include <linux/workqueue.h>
 
+#include "bitboard.h"
+#include "cpu_budget.h"
+#include "fixed.h"
 #include "game.h"
+#include "gamecount.h"
 #include "mcts.h"
+#include "node_pool.h"
+#include "playout.h"
+#include "result_cache.h"
 #include "util.h"
+#include "zobrist.h"
 
-struct node {
-    int move;
+/* The iteration budget is split over several workers, each with its own PRNG
+ * stream and node pool.
+ *
+ * Root parallelism: every worker grows its own tree from the same position
+ * and the root child visit counts are summed to pick the move.
+ *
+ * Shared tree: all workers descend one tree. A visit is counted as soon as a
+ * worker steps into a node and its reward only lands on the way back up, so
+ * in-flight playouts act as a virtual loss that spreads the workers over
+ * different branches. Children are published with cmpxchg().
+ */
+static unsigned int mcts_threads;
+module_param(mcts_threads, uint, 0644);
+MODULE_PARM_DESC(mcts_threads,
+                 "Parallel MCTS workers per search (0: one per online CPU)");
+
+static unsigned long mcts_seed;
+module_param(mcts_seed, ulong, 0644);
+MODULE_PARM_DESC(mcts_seed,
+                 "Fixed PRNG seed making every search reproducible (0: off)");
+
+static bool mcts_shared_tree;
+module_param(mcts_shared_tree, bool, 0644);
+MODULE_PARM_DESC(mcts_shared_tree,
+                 "Let the MCTS workers share one tree instead of one each");
+
+static bool mcts_reuse_tree = true;
+module_param(mcts_reuse_tree, bool, 0644);
+MODULE_PARM_DESC(mcts_reuse_tree,
+                 "Keep the subtree of the moves played for the next search");
+
+static unsigned int mcts_playouts = 1;
+module_param(mcts_playouts, uint, 0644);
+MODULE_PARM_DESC(mcts_playouts,
+                 "Random playouts per MCTS leaf, their mean reward is "
+                 "backpropagated");
+
+static unsigned int mcts_playout_kernel;
+module_param(mcts_playout_kernel, uint, 0644);
+MODULE_PARM_DESC(mcts_playout_kernel,
+                 "Kernel running more than one playout per leaf (0: widest "
+                 "available, 1: scalar, 2: 64-lane bit-sliced, 3: 256-lane "
+                 "AVX2)");
+
+#define MCTS_MAX_PLAYOUTS 4096
+
+static unsigned int mcts_iterations = ITERATIONS;
+module_param(mcts_iterations, uint, 0644);
+MODULE_PARM_DESC(mcts_iterations, "Playouts each MCTS search runs");
+
+/* How the playouts pick their moves, for the MCTS player of each game */
+static unsigned int mcts_rollout[MAX_GAMES];
+module_param_array(mcts_rollout, uint, NULL, 0644);
+MODULE_PARM_DESC(mcts_rollout,
+                 "Rollout policy of every game (0: uniformly random, 1: win "
+                 "if possible, else block the opponent's win, else random)");
+
+static const char *const mcts_rollout_names[NR_MCTS_ROLLOUTS] = {
+    [MCTS_ROLLOUT_RANDOM] = "random",
+    [MCTS_ROLLOUT_TACTICAL] = "tactical",
+};
+
+/* Transpositions: the same position reached through different move orders
+ * is searched once. Every expanded position is entered in a per-search hash
+ * table by its Zobrist key, and a leaf about to be expanded whose position is
+ * already in there becomes an alias of that node instead, handing its
+ * statistics over. The tree turns into a DAG whose nodes hold the statistics
+ * of positions, updated along the path each iteration took (UCT1), and whose
+ * subtrees are shared by every path into them.
+ */
+static bool mcts_transpositions;
+module_param(mcts_transpositions, bool, 0644);
+MODULE_PARM_DESC(mcts_transpositions,
+                 "Share MCTS nodes between move orders reaching the same "
+                 "position");
+
+#define MCTS_DAG_PROBES 16
+
+/* A search whose pools hold mcts_max_nodes stops growing its tree: a leaf it
+ * has no room to expand is played out again instead, so the iterations still
+ * refine the estimates of the nodes already there.
+ */
+static unsigned int mcts_max_nodes;
+module_param(mcts_max_nodes, uint, 0644);
+MODULE_PARM_DESC(mcts_max_nodes,
+                 "MCTS nodes one search may allocate, split over its pools "
+                 "(0: as many as a pool holds)");
+
+struct mcts_dag {
+    unsigned long mask;
+    struct {
+        u64 key; /* 0 when free */
+        u32 node;
+    } entries[];
+};
+
+/* Searches always run at least a tenth of their iterations fresh, however
+ * many visits the reused subtree brings along.
+ */
+#define MCTS_MIN_ITERATIONS(iterations) ((iterations) / 10)
+
+struct mcts_worker {
+    struct work_struct work;
+    const struct bitboard *board;
     char player;
-    int n_visits;
-    fixed_point_t score;
-    struct node *parent;
-    struct node *children[N_GRIDS];
+    bool shared;
+    int iterations;
+    int done;          /* iterations actually run */
+    unsigned int proven; /* nodes this worker proved */
+    struct node_pool *pool; /* tree rooted at NODE_ROOT */
+    struct state_array xoro_obj;
+    int visits[N_GRIDS]; /* per root move, -1 when the move is not legal */
+    u64 key; /* Zobrist key of *board */
+    struct mcts_dag *dag; /* NULL for a tree, shared with the pool */
+    unsigned int transpositions; /* leaves this worker turned into aliases */
+    unsigned int capped; /* leaves played out for want of nodes */
+    unsigned int playouts; /* per leaf */
+    enum mcts_rollout rollout;
+    enum playout_kernel kernel;
+    struct playout_lanes *lanes; /* NULL for the scalar kernel */
+    s64 kernel_playouts;
+    s64 kernel_nsec;
+};
+
+/* What a game keeps between two of its searches: the trees grown for the
+ * position in @board, one per pool.
+ */
+struct mcts_tree {
+    struct bitboard board;
+    char player;
+    bool shared;
+    unsigned int nr_pools;
+    struct node_pool *pools[MCTS_MAX_WORKERS];
 };
 
 static struct mcts_info mcts_obj;
+static struct workqueue_struct *mcts_wq;
+
+static inline size_t mcts_dag_bytes(const struct mcts_dag *dag);
 
-static struct node *new_node(int move, char player, struct node *parent)
+/* Account the pools and transposition tables of the first @n workers, the
+ * others share them
+ */
+static void mcts_account(const struct mcts_worker *workers, unsigned int n)
 {
-    struct node *node = kzalloc(sizeof(struct node), GFP_KERNEL);
-    node->move = move;
-    node->player = player;
-    node->n_visits = 0;
-    node->score = 0;
-    node->parent = parent;
-    memset(node->children, 0, sizeof(node->children));
-    return node;
+    unsigned long bytes = 0, nodes = 0;
+    s64 alloc_nsec = 0;
+
+    for (unsigned int k = 0; k < n; k++) {
+        const struct node_pool *pool = workers[k].pool;
+        bytes += node_pool_bytes(pool) + mcts_dag_bytes(workers[k].dag);
+        nodes += atomic_read(&pool->next);
+        alloc_nsec += atomic64_read(&pool->alloc_nsec);
+    }
+
+    atomic64_add(nodes, &mcts_obj.nr_alloc_nodes);
+    atomic64_add(alloc_nsec, &mcts_obj.alloc_nsec);
+
+    unsigned long peak = atomic_long_read(&mcts_obj.peak_pool_bytes);
+    while (bytes > peak) {
+        unsigned long old =
+            atomic_long_cmpxchg(&mcts_obj.peak_pool_bytes, peak, bytes);
+        if (old == peak)
+            break;
+        peak = old;
+    }
 }
 
-static void free_node(struct node *node)
+static void init_node(struct node_pool *pool, u32 idx, u32 parent, u8 move)
 {
-    for (int i = 0; i < N_GRIDS; i++)
-        if (node->children[i])
-            free_node(node->children[i]);
-    kfree(node);
+    struct node_stats *stats = node_stats(pool, idx);
+    struct node_link *link = node_link(pool, idx);
+    atomic_set(&stats->n_visits, 0);
+    atomic_set(&stats->score, 0);
+    link->children = 0;
+    link->parent = parent;
+    link->move = move;
+    link->proof = NODE_UNPROVEN;
 }
 
-static fixed_point_t fixed_sqrt(fixed_point_t x)
+static u32 select_move(const struct node_pool *pool, u32 idx)
 {
-    if (!x || x == (1U << FIXED_SCALE_BITS))
-        return x;
+    u32 children = READ_ONCE(node_link(pool, idx)->children);
+    if (!children)
+        return NODE_NONE;
 
-    fixed_point_t s = 0U;
-    for (int i = (31 - __builtin_clz(x | 1)); i >= 0; i--) {
-        fixed_point_t t = (1U << i);
-        if ((((s + t) * (s + t)) >> FIXED_SCALE_BITS) <= x)
-            s += t;
+    /* The children sit next to each other, score them in one sweep */
+    u32 first = node_first_child(children);
+    const struct node_stats *stats = node_stats(pool, first);
+    const struct node_link *links = node_link(pool, first);
+    u32 best_node = NODE_NONE;
+    u32 best_score = 0U;
+    u32 parent_factor =
+        uct_parent_factor(atomic_read(&node_stats(pool, idx)->n_visits));
+    for (unsigned int i = 0; i < node_nr_children(children); i++) {
+        const struct node_stats *s = &stats[i];
+        u8 proof = READ_ONCE(links[i].proof);
+        u32 alias = READ_ONCE(links[i].children);
+        if (alias & NODE_ALIAS) {
+            s = node_stats(pool, alias & ~NODE_ALIAS);
+            proof = READ_ONCE(node_link(pool, alias & ~NODE_ALIAS)->proof);
+        }
+        if (proof == NODE_LOSS)
+            continue;
+        u32 score = uct_value(parent_factor, atomic_read(&s->n_visits),
+                              (fixed_point_t) atomic_read(&s->score));
+        if (score > best_score) {
+            best_score = score;
+            best_node = first + i;
+        }
     }
-    return s;
+    /* Every move loses, the node is about to be proven */
+    return best_node != NODE_NONE ? best_node : first;
 }
 
-static fixed_point_t fixed_log(fixed_point_t v)
+/* Play random moves from @board, @player to move, and return the reward of
+ * the player who moved into @board, like a terminal node would.
+ */
+static fixed_point_t simulate(struct state_array *xoro_obj,
+                              const struct bitboard *board,
+                              char player)
 {
-    if (!v || v == (1U << FIXED_SCALE_BITS))
+    char current_player = player;
+    char mover = player ^ 'O' ^ 'X';
+    struct bitboard b = *board;
+    while (1) {
+        int moves[N_GRIDS];
+        int n_moves = bb_moves(&b, moves);
+        if (!n_moves)
+            break;
+        int move = moves[xoro_bounded(xoro_obj, n_moves)];
+        bb_play(&b, move, current_player);
+        /* Only the move just played can have completed a line */
+        if (bb_completes_line(b.pieces[BB_SIDE(current_player)], move))
+            return calculate_win_value(current_player, mover);
+        current_player ^= 'O' ^ 'X';
+    }
+    return (fixed_point_t) (1UL << (FIXED_SCALE_BITS - 1));
+}
+
+/* Grids where @own would complete segment @i with one more piece */
+static inline bitboard_t segment_threats(bitboard_t own,
+                                         bitboard_t theirs,
+                                         int i)
+{
+    if ((theirs & line_masks[i]) ||
+        bb_popcount(own & line_masks[i]) != GOAL - 1)
         return 0;
+    return line_masks[i] & ~own;
+}
 
-    fixed_point_t numerator = (v - (1U << FIXED_SCALE_BITS));
-    int neg = 0;
-    if (GET_SIGN(numerator)) {
-        neg = 1;
-        numerator = CLR_SIGN(numerator);
-        numerator = (1U << 31) - numerator;
+/* The first grid of @threats that wins for @own, and drop those that do not:
+ * a segment the opponent entered or, without ALLOW_EXCEED, that @own
+ * extended past an end stays dead.
+ */
+static int find_win(bitboard_t *threats, bitboard_t own, bitboard_t empty)
+{
+    for (bitboard_t t = *threats & empty; t; t &= t - 1) {
+        int cell = __ffs64(t);
+        if (bb_completes_line(own | BB_CELL(cell), cell))
+            return cell;
+        *threats &= ~BB_CELL(cell);
     }
+    return -1;
+}
+
+/* simulate() with the tactical policy: take a win if there is one, else
+ * block the one the opponent threatens, else play at random. threats[] holds
+ * a superset of the grids completing a line for each side, updated through
+ * the segments of every move and checked by find_win() before use.
+ */
+static fixed_point_t simulate_tactical(struct state_array *xoro_obj,
+                                       const struct bitboard *board,
+                                       char player)
+{
+    char current_player = player;
+    char mover = player ^ 'O' ^ 'X';
+    struct bitboard b = *board;
+    bitboard_t threats[2] = {0, 0};
 
-    fixed_point_t y =
-        (numerator << FIXED_SCALE_BITS) / (v + (1U << FIXED_SCALE_BITS));
+    for (int i = 0; i < N_LINE_SEGMENTS; i++)
+        for (int side = 0; side < 2; side++)
+            threats[side] |=
+                segment_threats(b.pieces[side], b.pieces[!side], i);
 
-    fixed_point_t ans = 0U;
-    for (unsigned i = 1; i < 20; i += 2) {
-        fixed_point_t z = (1U << FIXED_SCALE_BITS);
-        for (int j = 0; j < i; j++) {
-            z *= y;
-            z >>= FIXED_SCALE_BITS;
+    while (1) {
+        bitboard_t empty = bb_empty(&b);
+        if (!empty)
+            break;
+        int side = BB_SIDE(current_player);
+        if (find_win(&threats[side], b.pieces[side], empty) >= 0)
+            return calculate_win_value(current_player, mover);
+        int move = find_win(&threats[!side], b.pieces[!side], empty);
+        if (move < 0) {
+            int moves[N_GRIDS];
+            int n_moves = bb_moves(&b, moves);
+            move = moves[xoro_bounded(xoro_obj, n_moves)];
         }
-        z <<= FIXED_SCALE_BITS;
-        z /= (i << FIXED_SCALE_BITS);
+        bb_play(&b, move, current_player);
+        /* Any win was taken above, so the move completes nothing */
+        for (int k = 0; k < cell_nr_lines[move]; k++)
+            threats[side] |= segment_threats(b.pieces[side], b.pieces[!side],
+                                             cell_lines[move][k]);
+        current_player ^= 'O' ^ 'X';
+    }
+    return (fixed_point_t) (1UL << (FIXED_SCALE_BITS - 1));
+}
 
-        ans += z;
+static fixed_point_t rollout(struct mcts_worker *w,
+                             const struct bitboard *board,
+                             char player)
+{
+    if (w->rollout == MCTS_ROLLOUT_TACTICAL)
+        return simulate_tactical(&w->xoro_obj, board, player);
+    return simulate(&w->xoro_obj, board, player);
+}
+
+/* Reward of a leaf: a single playout, or the mean of w->playouts of them run
+ * by w->kernel.
+ */
+static fixed_point_t simulate_leaf(struct mcts_worker *w,
+                                   const struct bitboard *board,
+                                   char player)
+{
+    if (w->playouts == 1)
+        return rollout(w, board, player);
+
+    ktime_t start = ktime_get();
+    unsigned int half_points = 0;
+    if (w->lanes) {
+        half_points = playout_run(w->lanes, w->kernel, &w->xoro_obj, board,
+                                  player, w->playouts);
+    } else {
+        for (unsigned int i = 0; i < w->playouts; i++)
+            half_points += rollout(w, board, player) >> (FIXED_SCALE_BITS - 1);
     }
-    ans <<= 1;
-    ans = neg ? SET_SIGN(ans) : ans;
-    return ans;
+    w->kernel_playouts += w->playouts;
+    w->kernel_nsec += ktime_to_ns(ktime_sub(ktime_get(), start));
+    return (half_points << (FIXED_SCALE_BITS - 1)) / w->playouts;
 }
 
-#define EXPLORATION_FACTOR fixed_sqrt(1U << (FIXED_SCALE_BITS + 1))
+/* MCTS-Solver: a node whose outcome is settled is not sampled any more.
+ * Terminal positions are proven when selection reaches them and the proofs
+ * travel up with the rewards: a node is lost for the player who moved into it
+ * once one child wins for the side to move, and takes the best outcome of its
+ * children once all of them are proven. Proven-losing children are never
+ * selected, and a proven root ends the search.
+ */
+static u8 solve(const struct node_pool *pool, u32 idx)
+{
+    u32 children = READ_ONCE(node_link(pool, idx)->children);
+    if (!children)
+        return NODE_UNPROVEN;
+
+    u32 first = node_first_child(children);
+    bool open = false;
+    u8 best = NODE_LOSS;
+    for (unsigned int i = 0; i < node_nr_children(children); i++) {
+        u32 child = node_target(pool, first + i);
+        u8 proof = READ_ONCE(node_link(pool, child)->proof);
+        if (proof == NODE_WIN)
+            return NODE_LOSS;
+        if (proof == NODE_UNPROVEN)
+            open = true;
+        else
+            best = max(best, proof);
+    }
+    return open ? NODE_UNPROVEN : NODE_WIN + NODE_LOSS - best;
+}
 
-static inline fixed_point_t uct_score(int n_total,
-                                      int n_visits,
-                                      fixed_point_t score)
+static u8 prove(struct mcts_worker *w, struct node_link *link, u8 proof)
 {
-    if (n_visits == 0)
-        return FIXED_MAX;
+    WRITE_ONCE(link->proof, proof);
+    w->proven++;
+    return proof;
+}
 
-    fixed_point_t result =
-        score << FIXED_SCALE_BITS /
-                     (fixed_point_t) (n_visits << FIXED_SCALE_BITS);
-    fixed_point_t tmp =
-        EXPLORATION_FACTOR *
-        fixed_sqrt(fixed_log(n_total << FIXED_SCALE_BITS) / n_visits);
-    tmp >>= FIXED_SCALE_BITS;
-    return result + tmp;
+static u8 prove_terminal(struct mcts_worker *w,
+                         struct node_link *link,
+                         char win,
+                         char mover)
+{
+    if (win == mover)
+        return prove(w, link, NODE_WIN);
+    return prove(w, link, win == 'D' ? NODE_DRAW : NODE_LOSS);
 }
 
-static struct node *select_move(struct node *node)
+/* The reward a proven node hands back, as calculate_win_value() would */
+static inline fixed_point_t proof_reward(u8 proof)
 {
-    struct node *best_node = NULL;
-    fixed_point_t best_score = 0U;
-    for (int i = 0; i < N_GRIDS; i++) {
-        if (!node->children[i])
-            continue;
-        fixed_point_t score =
-            uct_score(node->n_visits, node->children[i]->n_visits,
-                      node->children[i]->score);
-        if (score > best_score) {
-            best_score = score;
-            best_node = node->children[i];
+    return (fixed_point_t) (proof - NODE_LOSS) << (FIXED_SCALE_BITS - 1);
+}
+
+/* Add the reward of a playout, or of a proven node, to the @depth nodes of
+ * @path from the last one up to the root, and extend the proof of the last
+ * one to the ancestors it settles. The rewards follow the path rather than
+ * the parent links, since a transposition has a parent for every way in.
+ */
+static void backpropagate(struct mcts_worker *w,
+                          const u32 *path,
+                          int depth,
+                          fixed_point_t score)
+{
+    struct node_pool *pool = w->pool;
+    bool proving =
+        READ_ONCE(node_link(pool, path[depth - 1])->proof) != NODE_UNPROVEN;
+    while (depth--) {
+        u32 idx = path[depth];
+        struct node_stats *stats = node_stats(pool, idx);
+        struct node_link *link = node_link(pool, idx);
+        atomic_inc(&stats->n_visits);
+        atomic_add(score, &stats->score);
+        if (proving && !READ_ONCE(link->proof)) {
+            u8 proof = solve(pool, idx);
+            proving = proof && prove(w, link, proof);
         }
+        score = (1U << FIXED_SCALE_BITS) - score;
     }
-    return best_node;
 }
 
-static fixed_point_t simulate(const char *table, char player)
+/* Shared tree: the visits were already counted on the way down */
+static void backpropagate_reward(struct mcts_worker *w,
+                                 const u32 *path,
+                                 int depth,
+                                 fixed_point_t score)
 {
-    char current_player = player;
-    char temp_table[N_GRIDS];
-    memcpy(temp_table, table, N_GRIDS);
-    xoro_jump(&(mcts_obj.xoro_obj));
-    while (1) {
-        int *moves = available_moves(temp_table);
-        if (moves[0] == -1) {
-            kfree(moves);
+    struct node_pool *pool = w->pool;
+    bool proving =
+        READ_ONCE(node_link(pool, path[depth - 1])->proof) != NODE_UNPROVEN;
+    while (depth--) {
+        u32 idx = path[depth];
+        struct node_link *link = node_link(pool, idx);
+        atomic_add(score, &node_stats(pool, idx)->score);
+        if (proving && !READ_ONCE(link->proof)) {
+            u8 proof = solve(pool, idx);
+            proving = proof && prove(w, link, proof);
+        }
+        score = (1U << FIXED_SCALE_BITS) - score;
+    }
+}
+
+/* The children are built in a block of their own and published with a single
+ * cmpxchg(), so racing workers of a shared tree settle on one block and the
+ * others stay unused in the pool until the search ends.
+ */
+static int expand(struct node_pool *pool, u32 idx, const struct bitboard *board)
+{
+    struct node_link *link = node_link(pool, idx);
+    int moves[N_GRIDS];
+    int n_moves = bb_moves(board, moves);
+    if (!n_moves)
+        return 0;
+    u32 first = node_pool_reserve(pool, n_moves);
+    if (first == NODE_NONE)
+        return -ENOMEM;
+    u8 player = (link->move & NODE_PLAYER_X) ^ NODE_PLAYER_X;
+    for (int i = 0; i < n_moves; i++)
+        init_node(pool, first + i, idx, moves[i] | player);
+    cmpxchg(&link->children, 0, first << NODE_COUNT_BITS | n_moves);
+    return n_moves;
+}
+
+static inline size_t mcts_dag_bytes(const struct mcts_dag *dag)
+{
+    return dag ? struct_size(dag, entries, dag->mask + 1) : 0;
+}
+
+/* Room for every position @iterations can expand in @pool, at most half
+ * full. A position is only expanded into nodes of the pool, so its node
+ * budget bounds the table as well.
+ */
+static struct mcts_dag *mcts_dag_alloc(int iterations,
+                                       const struct node_pool *pool)
+{
+    unsigned int positions =
+        min_t(unsigned int, max(iterations, 1), pool->max_nodes);
+    unsigned long size = roundup_pow_of_two(2 * positions);
+    struct mcts_dag *dag =
+        kvzalloc(struct_size(dag, entries, size), GFP_KERNEL);
+    if (dag) {
+        dag->mask = size - 1;
+        atomic_long_add(mcts_dag_bytes(dag), &mcts_obj.dag_bytes);
+    }
+    return dag;
+}
+
+static void mcts_dag_free(struct mcts_dag *dag)
+{
+    atomic_long_sub(mcts_dag_bytes(dag), &mcts_obj.dag_bytes);
+    kvfree(dag);
+}
+
+static u32 mcts_dag_find(const struct mcts_dag *dag, u64 key)
+{
+    unsigned long i = key & dag->mask;
+    for (int n = 0; key && n < MCTS_DAG_PROBES; n++) {
+        u64 k = READ_ONCE(dag->entries[i].key);
+        if (!k)
             break;
+        if (k == key) {
+            /* Claimed, but maybe not filled in yet */
+            u32 node = READ_ONCE(dag->entries[i].node);
+            return node ? node : NODE_NONE;
         }
-        int n_moves = 0;
-        while (n_moves < N_GRIDS && moves[n_moves] != -1)
-            ++n_moves;
-        int move = moves[xoro_next(&(mcts_obj.xoro_obj)) % n_moves];
-        kfree(moves);
-        temp_table[move] = current_player;
-        char win;
-        if ((win = check_win(temp_table)) != ' ')
-            return calculate_win_value(win, player);
-        current_player ^= 'O' ^ 'X';
+        i = (i + 1) & dag->mask;
     }
-    return (fixed_point_t) (1UL << (FIXED_SCALE_BITS - 1));
+    return NODE_NONE;
 }
 
-static void backpropagate(struct node *node, fixed_point_t score)
+/* The root is never stored, so node 0 marks an entry being filled in */
+static void mcts_dag_insert(struct mcts_dag *dag, u64 key, u32 node)
 {
-    while (node) {
-        node->n_visits++;
-        node->score += score;
-        node = node->parent;
-        score = 1 - score;
+    unsigned long i = key & dag->mask;
+    for (int n = 0; key && n < MCTS_DAG_PROBES; n++) {
+        u64 k = cmpxchg(&dag->entries[i].key, 0, key);
+        if (!k) {
+            WRITE_ONCE(dag->entries[i].node, node);
+            return;
+        }
+        if (k == key)
+            return;
+        i = (i + 1) & dag->mask;
     }
 }
 
-static int expand(struct node *node, const char *table)
+/* Give the leaf @idx children. With a DAG, a position some other path already
+ * expanded turns @idx into an alias of that node, which takes over the
+ * statistics of @idx. Returns the node holding the children, or NODE_NONE
+ * when the pool is exhausted.
+ */
+static u32 mcts_expand(struct mcts_worker *w,
+                       u32 idx,
+                       u64 key,
+                       const struct bitboard *board)
 {
-    int *moves = available_moves(table);
-    int n_moves = 0;
-    while (n_moves < N_GRIDS && moves[n_moves] != -1)
-        ++n_moves;
-    for (int i = 0; i < n_moves; i++) {
-        node->children[i] = new_node(moves[i], node->player ^ 'O' ^ 'X', node);
+    struct node_pool *pool = w->pool;
+    struct node_link *link = node_link(pool, idx);
+
+    if (w->dag) {
+        u32 target = mcts_dag_find(w->dag, key);
+        if (target != NODE_NONE && target != idx &&
+            !cmpxchg(&link->children, 0, NODE_ALIAS | target)) {
+            /* In-flight shared-tree rewards still land on @idx, and are lost */
+            struct node_stats *from = node_stats(pool, idx);
+            struct node_stats *to = node_stats(pool, target);
+            atomic_add(atomic_read(&from->n_visits), &to->n_visits);
+            atomic_add(atomic_read(&from->score), &to->score);
+            w->transpositions++;
+        }
     }
-    kfree(moves);
-    return n_moves;
+    if (!READ_ONCE(link->children)) {
+        if (expand(pool, idx, board) < 0)
+            return NODE_NONE;
+        if (w->dag)
+            mcts_dag_insert(w->dag, key, idx);
+    }
+    return node_target(pool, idx);
 }
 
-int mcts(const char *table, char player)
+/* Grow the private tree in w->pool for w->iterations */
+static void mcts_search(struct mcts_worker *w)
 {
-    char win;
-    struct node *root = new_node(-1, player, NULL);
-    mcts_obj.nr_active_nodes = 1;
-    for (int i = 0; i < ITERATIONS; i++) {
-        struct node *node = root;
-        char temp_table[N_GRIDS];
-        memcpy(temp_table, table, N_GRIDS);
+    const struct node_link *root = node_link(w->pool, NODE_ROOT);
+    u32 path[N_GRIDS + 1];
+    for (w->done = 0; w->done < w->iterations; w->done++) {
+        if (READ_ONCE(root->proof))
+            return;
+        u32 node = NODE_ROOT;
+        struct bitboard board = *w->board;
+        u64 key = w->key;
+        int depth = 0;
         while (1) {
-            if ((win = check_win(temp_table)) != ' ') {
-                fixed_point_t score =
-                    calculate_win_value(win, node->player ^ 'O' ^ 'X');
-                backpropagate(node, score);
+            struct node_link *link = node_link(w->pool, node);
+            char player = node_player(link);
+            char win;
+            path[depth++] = node;
+            u8 proof = READ_ONCE(link->proof);
+            if (!proof && (win = bb_check_win(&board)) != ' ')
+                proof = prove_terminal(w, link, win, player ^ 'O' ^ 'X');
+            if (proof) {
+                backpropagate(w, path, depth, proof_reward(proof));
                 break;
             }
-            if (node->n_visits == 0) {
-                fixed_point_t score = simulate(temp_table, node->player);
-                backpropagate(node, score);
+            if (atomic_read(&node_stats(w->pool, node)->n_visits) == 0) {
+                fixed_point_t score = simulate_leaf(w, &board, player);
+                backpropagate(w, path, depth, score);
                 break;
             }
-            if (node->children[0] == NULL)
-                mcts_obj.nr_active_nodes += expand(node, temp_table);
-            node = select_move(node);
-            if (!node)
-                return -1;
-            temp_table[node->move] = node->player ^ 'O' ^ 'X';
+            if (!link->children) {
+                u32 expanded = mcts_expand(w, node, key, &board);
+                if (expanded == NODE_NONE) {
+                    fixed_point_t score = simulate_leaf(w, &board, player);
+                    backpropagate(w, path, depth, score);
+                    w->capped++;
+                    break;
+                }
+                if (expanded != node) {
+                    node = expanded;
+                    depth--;
+                    continue;
+                }
+            }
+            u32 child = select_move(w->pool, node);
+            if (child == NODE_NONE)
+                return;
+            int move = node_move(node_link(w->pool, child));
+            bb_play(&board, move, player);
+            key ^= zobrist_table[move][BB_SIDE(player)];
+            node = node_target(w->pool, child);
         }
     }
-    struct node *best_node = root;
+}
+
+/* Descend the tree shared through w->pool for w->iterations */
+static void mcts_search_shared(struct mcts_worker *w)
+{
+    const struct node_link *root = node_link(w->pool, NODE_ROOT);
+    u32 path[N_GRIDS + 1];
+    for (w->done = 0; w->done < w->iterations; w->done++) {
+        if (READ_ONCE(root->proof))
+            return;
+        u32 node = NODE_ROOT;
+        struct bitboard board = *w->board;
+        u64 key = w->key;
+        int depth = 0;
+        bool first_visit =
+            atomic_inc_return(&node_stats(w->pool, node)->n_visits) == 1;
+        while (1) {
+            struct node_link *link = node_link(w->pool, node);
+            char player = node_player(link);
+            char win;
+            path[depth++] = node;
+            u8 proof = READ_ONCE(link->proof);
+            if (!proof && (win = bb_check_win(&board)) != ' ')
+                proof = prove_terminal(w, link, win, player ^ 'O' ^ 'X');
+            if (proof) {
+                backpropagate_reward(w, path, depth, proof_reward(proof));
+                break;
+            }
+            if (first_visit) {
+                fixed_point_t score = simulate_leaf(w, &board, player);
+                backpropagate_reward(w, path, depth, score);
+                break;
+            }
+            if (!READ_ONCE(link->children)) {
+                u32 expanded = mcts_expand(w, node, key, &board);
+                if (expanded == NODE_NONE) {
+                    fixed_point_t score = simulate_leaf(w, &board, player);
+                    backpropagate_reward(w, path, depth, score);
+                    w->capped++;
+                    break;
+                }
+                if (expanded != node) {
+                    node = expanded;
+                    depth--;
+                    continue;
+                }
+            }
+            u32 child = select_move(w->pool, node);
+            if (child == NODE_NONE)
+                return;
+            int move = node_move(node_link(w->pool, child));
+            bb_play(&board, move, player);
+            key ^= zobrist_table[move][BB_SIDE(player)];
+            node = node_target(w->pool, child);
+            /* Virtual loss: the visit counts before the reward arrives */
+            first_visit =
+                atomic_inc_return(&node_stats(w->pool, node)->n_visits) == 1;
+        }
+    }
+}
+
+static void mcts_worker_func(struct work_struct *work)
+{
+    struct mcts_worker *w = container_of(work, struct mcts_worker, work);
+    if (w->shared)
+        mcts_search_shared(w);
+    else
+        mcts_search(w);
+}
+
+static unsigned int mcts_nr_workers(void)
+{
+    unsigned int n = READ_ONCE(mcts_threads);
+    if (!n)
+        n = num_online_cpus();
+    return clamp_t(unsigned int, n, 1, MCTS_MAX_WORKERS);
+}
+
+static u32 find_child(const struct node_pool *pool, u32 idx, int move)
+{
+    u32 children = node_link(pool, idx)->children;
+    u32 first = node_first_child(children);
+    for (unsigned int i = 0; i < node_nr_children(children); i++)
+        if (node_move(node_link(pool, first + i)) == move)
+            return first + i;
+    return NODE_NONE;
+}
+
+/* Copy the descendants of @s in @src below @d in @dst, keeping every family
+ * of children in one block. Recursion is bounded by the number of grids.
+ */
+static bool copy_children(struct node_pool *dst,
+                          u32 d,
+                          const struct node_pool *src,
+                          u32 s)
+{
+    u32 children = node_link(src, s)->children;
+    unsigned int count = node_nr_children(children);
+    if (!count)
+        return true;
+    u32 first = node_pool_reserve(dst, count);
+    if (first == NODE_NONE)
+        return false;
+
+    u32 src_first = node_first_child(children);
+    for (unsigned int i = 0; i < count; i++) {
+        const struct node_stats *from = node_stats(src, src_first + i);
+        struct node_stats *to = node_stats(dst, first + i);
+        const struct node_link *link = node_link(src, src_first + i);
+        init_node(dst, first + i, d, link->move);
+        node_link(dst, first + i)->proof = link->proof;
+        atomic_set(&to->n_visits, atomic_read(&from->n_visits));
+        atomic_set(&to->score, atomic_read(&from->score));
+    }
+    node_link(dst, d)->children = first << NODE_COUNT_BITS | count;
+    for (unsigned int i = 0; i < count; i++)
+        if (!copy_children(dst, first + i, src, src_first + i))
+            return false;
+    return true;
+}
+
+/* Find the grids taken by @player and then by the opponent since @tree was
+ * stored, if @board is exactly two plies further.
+ */
+static bool mcts_tree_moves(const struct mcts_tree *tree,
+                            const struct bitboard *board,
+                            char player,
+                            int *mine,
+                            int *theirs)
+{
+    if (!tree->nr_pools || tree->player != player)
+        return false;
+
+    bitboard_t own = board->pieces[BB_SIDE(player)];
+    bitboard_t opp = board->pieces[!BB_SIDE(player)];
+    bitboard_t old_own = tree->board.pieces[BB_SIDE(player)];
+    bitboard_t old_opp = tree->board.pieces[!BB_SIDE(player)];
+    if ((own & old_own) != old_own || (opp & old_opp) != old_opp)
+        return false;
+    own ^= old_own;
+    opp ^= old_opp;
+    if (bb_popcount(own) != 1 || bb_popcount(opp) != 1)
+        return false;
+    *mine = __ffs64(own);
+    *theirs = __ffs64(opp);
+    return true;
+}
+
+/* Give back the nodes @tree kept, e.g. once its game is over */
+void mcts_tree_release(struct mcts_tree *tree)
+{
+    if (!tree)
+        return;
+    for (unsigned int k = 0; k < tree->nr_pools; k++)
+        node_pool_destroy(tree->pools[k]);
+    tree->nr_pools = 0;
+}
+
+/* Root of the tree in @pool for this search: the grandchild of the stored
+ * root @k that matches the two moves played, or a new node when there is
+ * nothing to reuse. Returns the visits brought along, or -ENOMEM.
+ */
+static int mcts_root(struct mcts_tree *tree,
+                     unsigned int k,
+                     struct node_pool *pool,
+                     int mine,
+                     int theirs,
+                     char player)
+{
+    if (node_pool_reserve(pool, 1) != NODE_ROOT)
+        return -ENOMEM;
+    init_node(pool, NODE_ROOT, NODE_NONE, player == 'X' ? NODE_PLAYER_X : 0);
+    if (!tree)
+        return 0;
+
+    const struct node_pool *old = tree->pools[k];
+    u32 child = find_child(old, NODE_ROOT, mine);
+    u32 grandchild =
+        child != NODE_NONE ? find_child(old, child, theirs) : NODE_NONE;
+    if (grandchild == NODE_NONE)
+        return 0;
+    if (!copy_children(pool, NODE_ROOT, old, grandchild)) {
+        /* Whatever was copied is left unused, start from scratch */
+        init_node(pool, NODE_ROOT, NODE_NONE,
+                  player == 'X' ? NODE_PLAYER_X : 0);
+        return 0;
+    }
+
+    struct node_stats *stats = node_stats(pool, NODE_ROOT);
+    const struct node_stats *from = node_stats(old, grandchild);
+    node_link(pool, NODE_ROOT)->proof = node_link(old, grandchild)->proof;
+    atomic_set(&stats->n_visits, atomic_read(&from->n_visits));
+    atomic_set(&stats->score, atomic_read(&from->score));
+    return atomic_read(&stats->n_visits);
+}
+
+/* Visit count of each move at the root of @pool, -1 when it is not legal and
+ * 0 when it is proven to lose while another does not. Returns a move proven
+ * to win, or -1.
+ */
+static int root_visits(const struct node_pool *pool, int *visits)
+{
+    const struct node_link *root = node_link(pool, NODE_ROOT);
+    bool lost = root->proof == NODE_WIN;
+    u32 first = node_first_child(root->children);
+    int won = -1;
+    for (unsigned int i = 0; i < node_nr_children(root->children); i++) {
+        const struct node_link *link = node_link(pool, first + i);
+        int move = node_move(link);
+        visits[move] = atomic_read(&node_stats(pool, first + i)->n_visits);
+        if (link->proof == NODE_LOSS && !lost)
+            visits[move] = 0;
+        else if (link->proof == NODE_WIN && won < 0)
+            won = move;
+    }
+    return won;
+}
+
+/* Key of a search in the result cache: a cached move is only replayed by a
+ * search run with the same parameters. All but mcts_max_nodes and mcts_seed
+ * fit in their own bits, those two are mixed into the whole key.
+ */
+static u64 mcts_cache_budget(enum mcts_rollout policy,
+                             int iterations,
+                             unsigned int playouts,
+                             enum playout_kernel kernel,
+                             bool dag,
+                             bool shared,
+                             unsigned int n,
+                             unsigned int max_nodes,
+                             unsigned long seed)
+{
+    BUILD_BUG_ON(NR_MCTS_ROLLOUTS > 2 || NR_PLAYOUT_KERNELS > 4 ||
+                 MCTS_MAX_PLAYOUTS >= 1 << 13 || MCTS_MAX_WORKERS >= 1 << 14);
+    u64 budget = (u64) iterations << 32 | n << 18 | shared << 17 |
+                 playouts << 4 | kernel << 2 | dag << 1 | policy;
+    u64 mix = (u64) max_nodes * GOLDEN_RATIO_64;
+    return budget ^ ((mix ^ seed) * GOLDEN_RATIO_64);
+}
+
+int mcts(struct mcts_tree *tree,
+         const char *table,
+         char player,
+         unsigned int game)
+{
+    int best_move = -1;
+    struct bitboard board;
+    bb_from_table(&board, table);
+    ktime_t start = ktime_get();
+
+    enum mcts_rollout policy = READ_ONCE(mcts_rollout[game % MAX_GAMES]);
+    if (policy >= NR_MCTS_ROLLOUTS)
+        policy = MCTS_ROLLOUT_RANDOM;
+    int iterations = clamp_t(unsigned int, READ_ONCE(mcts_iterations), 1,
+                             INT_MAX);
+    /* The iterations count playouts: more of them per leaf trade the depth
+     * of the tree for better estimates of its leaves.
+     */
+    unsigned int playouts =
+        clamp_t(unsigned int, READ_ONCE(mcts_playouts), 1, MCTS_MAX_PLAYOUTS);
+    enum playout_kernel kernel =
+        playout_kernel_select(READ_ONCE(mcts_playout_kernel));
+    bool dag = READ_ONCE(mcts_transpositions);
+    unsigned int max_nodes = READ_ONCE(mcts_max_nodes);
+    unsigned long seed = READ_ONCE(mcts_seed);
+
+    /* A private tree needs two iterations to have root children to vote
+     * with, so a small budget runs on fewer trees
+     */
+    bool shared = READ_ONCE(mcts_shared_tree);
+    unsigned int n = mcts_nr_workers();
+    if (!shared)
+        n = clamp_t(unsigned int, DIV_ROUND_UP(iterations, playouts) / 2, 1,
+                    n);
+
+    u64 cache_budget = mcts_cache_budget(policy, iterations, playouts, kernel,
+                                         dag, shared, n, max_nodes, seed);
+
+    /* Another game already searched the position, nothing to reuse after */
+    if (result_cache_get(RESULT_MCTS, table, player, cache_budget, &best_move,
+                         NULL)) {
+        if (tree)
+            mcts_tree_release(tree);
+        return best_move;
+    }
+
+    struct mcts_worker local;
+    struct mcts_worker *workers = NULL;
+    if (n > 1)
+        workers = kcalloc(n, sizeof(*workers), GFP_KERNEL);
+    if (!workers) {
+        memset(&local, 0, sizeof(local));
+        workers = &local;
+        n = 1;
+    }
+
+    unsigned int nr_pools = shared ? 1 : n;
+
+    int mine = -1, theirs = -1;
+    bool keep = tree && READ_ONCE(mcts_reuse_tree);
+    bool reuse = keep && tree->shared == shared && tree->nr_pools == nr_pools &&
+                 mcts_tree_moves(tree, &board, player, &mine, &theirs);
+
+    /* Room for the root and its children at least, or there is no move */
+    max_nodes = max_nodes ? max(max_nodes / nr_pools, 1U + N_GRIDS) : U32_MAX;
+
+    int inherited = 0;
+    for (unsigned int k = 0; k < nr_pools; k++) {
+        workers[k].pool = node_pool_create(max_nodes);
+        if (!workers[k].pool) {
+            nr_pools = k;
+            goto release;
+        }
+        int visits = mcts_root(reuse ? tree : NULL, k, workers[k].pool, mine,
+                               theirs, player);
+        if (visits < 0) {
+            nr_pools = k + 1;
+            goto release;
+        }
+        inherited += visits;
+    }
+    for (unsigned int k = nr_pools; k < n; k++)
+        workers[k].pool = workers[0].pool;
+    if (tree)
+        mcts_tree_release(tree);
+    if (inherited) {
+        atomic64_inc(&mcts_obj.reused_searches);
+        atomic64_add(inherited, &mcts_obj.reused_visits);
+    }
+
+    /* Each search owns a 2^96 long slice of the module-wide sequence, or
+     * restarts from mcts_seed, and hands every worker a 2^64 long stream.
+     */
+    struct state_array stream;
+    if (seed) {
+        xoro_seed(&stream, seed);
+    } else {
+        spin_lock(&mcts_obj.xoro_lock);
+        stream = mcts_obj.xoro_obj;
+        xoro_long_jump(&(mcts_obj.xoro_obj));
+        spin_unlock(&mcts_obj.xoro_lock);
+    }
+
+    /* The floor of fresh iterations is split over the workers, each of which
+     * rounds its share up to whole leaves, so that none is left without one
+     * however many playouts a leaf takes. A fresh root is only expanded by
+     * the second iteration, so no worker runs fewer than two.
+     */
+    unsigned int share = DIV_ROUND_UP(MCTS_MIN_ITERATIONS(iterations), n);
+    share = max_t(unsigned int, DIV_ROUND_UP(share, playouts), 2);
+    int budget = max((int) DIV_ROUND_UP(iterations, playouts) - inherited,
+                     (int) (n * share));
+    u64 key = 0;
+    for (int i = 0; i < N_GRIDS; i++)
+        if (table[i] != ' ')
+            key ^= zobrist_table[i][BB_SIDE(table[i])];
+    for (unsigned int k = 0; k < n; k++) {
+        struct mcts_worker *w = &workers[k];
+        w->board = &board;
+        w->player = player;
+        w->shared = shared;
+        w->iterations = budget / n + (k < budget % n);
+        for (int i = 0; i < N_GRIDS; i++)
+            w->visits[i] = -1;
+        w->xoro_obj = stream;
+        xoro_jump(&stream);
+        w->key = key;
+        /* Without a table the worker grows a plain tree */
+        if (dag && k < nr_pools)
+            w->dag = mcts_dag_alloc(shared ? budget : w->iterations,
+                                    w->pool);
+        else if (dag)
+            w->dag = workers[0].dag;
+        w->playouts = playouts;
+        w->rollout = policy;
+        /* Without scratch space the worker plays one playout at a time, and
+         * the kernels only play at random
+         */
+        if (playouts > 1 && kernel != PLAYOUT_SCALAR &&
+            policy == MCTS_ROLLOUT_RANDOM)
+            w->lanes = kmalloc(sizeof(*w->lanes), GFP_KERNEL);
+        w->kernel = w->lanes ? kernel : PLAYOUT_SCALAR;
+    }
+
+    /* Every worker keeps a CPU busy, negamax helpers only get the rest */
+    cpu_budget_take(n);
+    for (unsigned int k = 1; k < n; k++) {
+        INIT_WORK(&workers[k].work, mcts_worker_func);
+        queue_work(mcts_wq, &workers[k].work);
+    }
+    mcts_worker_func(&workers[0].work);
+    for (unsigned int k = 1; k < n; k++)
+        flush_work(&workers[k].work);
+    cpu_budget_put(n);
+
+    int won = -1;
+    for (unsigned int k = 0; k < nr_pools; k++) {
+        int move = root_visits(workers[k].pool, workers[k].visits);
+        if (won < 0)
+            won = move;
+    }
+
+    /* Sum the root statistics of every tree, ties go to the lowest grid */
     int most_visits = -1;
     for (int i = 0; i < N_GRIDS; i++) {
-        if (root->children[i] && root->children[i]->n_visits > most_visits) {
-            most_visits = root->children[i]->n_visits;
-            best_node = root->children[i];
+        int visits = -1;
+        for (unsigned int k = 0; k < n; k++) {
+            if (workers[k].visits[i] < 0)
+                continue;
+            visits = max(visits, 0) + workers[k].visits[i];
         }
+        if (visits > most_visits) {
+            most_visits = visits;
+            best_move = i;
+        }
+    }
+
+    if (won >= 0)
+        best_move = won;
+
+    int done = 0;
+    unsigned int proven = 0, transpositions = 0, capped = 0;
+    for (unsigned int k = 0; k < n; k++) {
+        done += workers[k].done;
+        proven += workers[k].proven;
+        transpositions += workers[k].transpositions;
+        capped += workers[k].capped;
+    }
+    atomic64_add(proven, &mcts_obj.proven_nodes);
+    atomic64_add(transpositions, &mcts_obj.transpositions);
+    atomic64_add(capped, &mcts_obj.capped_leaves);
+    if (capped)
+        atomic64_inc(&mcts_obj.capped_searches);
+    if (READ_ONCE(node_link(workers[0].pool, NODE_ROOT)->proof)) {
+        atomic64_inc(&mcts_obj.solved_searches);
+        atomic64_add(budget - done, &mcts_obj.saved_iterations);
     }
-    int best_move = best_node->move;
-    free_node(root);
+
+    s64 nsec = ktime_to_ns(ktime_sub(ktime_get(), start));
+    atomic64_add(done, &mcts_obj.playouts[shared][n - 1]);
+    atomic64_add(nsec, &mcts_obj.search_nsec[shared][n - 1]);
+    atomic64_add((s64) done * playouts, &mcts_obj.rollout_playouts[policy]);
+    atomic64_add(nsec, &mcts_obj.rollout_nsec[policy]);
+    for (unsigned int k = 0; k < n; k++) {
+        const struct mcts_worker *w = &workers[k];
+        atomic64_add(w->kernel_playouts, &mcts_obj.kernel_playouts[w->kernel]);
+        atomic64_add(w->kernel_nsec, &mcts_obj.kernel_nsec[w->kernel]);
+    }
+    result_cache_put(RESULT_MCTS, table, player, cache_budget, best_move, 0);
+
+release:
+    mcts_account(workers, nr_pools);
+    for (unsigned int k = 0; k < n; k++)
+        kfree(workers[k].lanes);
+    for (unsigned int k = 0; k < nr_pools; k++)
+        mcts_dag_free(workers[k].dag);
+
+    /* Hand the trees over to the game when it reuses them, a DAG cannot be
+     * cut at the root
+     */
+    if (keep && best_move >= 0 && !dag) {
+        tree->board = board;
+        tree->player = player;
+        tree->shared = shared;
+        tree->nr_pools = nr_pools;
+        for (unsigned int k = 0; k < nr_pools; k++)
+            tree->pools[k] = workers[k].pool;
+    } else {
+        if (tree)
+            mcts_tree_release(tree);
+        for (unsigned int k = 0; k < nr_pools; k++)
+            node_pool_destroy(workers[k].pool);
+    }
+    if (workers != &local)
+        kfree(workers);
+
+    /* Nothing was searched, e.g. out of memory: any legal move beats none */
+    for (int i = 0; best_move < 0 && i < N_GRIDS; i++)
+        if (table[i] == ' ')
+            best_move = i;
     return best_move;
 }
 
-void mcts_init(void)
+struct mcts_tree *mcts_tree_alloc(void)
 {
+    return kzalloc(sizeof(struct mcts_tree), GFP_KERNEL);
+}
+
+void mcts_tree_free(struct mcts_tree *tree)
+{
+    mcts_tree_release(tree);
+    kfree(tree);
+}
+
+int mcts_init(void)
+{
+    mcts_wq = alloc_workqueue("kxo_mcts", WQ_UNBOUND, 0);
+    if (!mcts_wq)
+        return -ENOMEM;
+    fixed_init();
+    spin_lock_init(&mcts_obj.xoro_lock);
     xoro_init(&(mcts_obj.xoro_obj));
-    mcts_obj.nr_active_nodes = 0;
+    atomic64_set(&mcts_obj.nr_alloc_nodes, 0);
+    atomic64_set(&mcts_obj.alloc_nsec, 0);
+    atomic_long_set(&mcts_obj.peak_pool_bytes, 0);
+    atomic_long_set(&mcts_obj.dag_bytes, 0);
+    atomic64_set(&mcts_obj.reused_searches, 0);
+    atomic64_set(&mcts_obj.reused_visits, 0);
+    atomic64_set(&mcts_obj.proven_nodes, 0);
+    atomic64_set(&mcts_obj.solved_searches, 0);
+    atomic64_set(&mcts_obj.saved_iterations, 0);
+    atomic64_set(&mcts_obj.transpositions, 0);
+    atomic64_set(&mcts_obj.capped_searches, 0);
+    atomic64_set(&mcts_obj.capped_leaves, 0);
+    for (int mode = 0; mode < 2; mode++) {
+        for (int k = 0; k < MCTS_MAX_WORKERS; k++) {
+            atomic64_set(&mcts_obj.playouts[mode][k], 0);
+            atomic64_set(&mcts_obj.search_nsec[mode][k], 0);
+        }
+    }
+    for (int k = 0; k < NR_PLAYOUT_KERNELS; k++) {
+        atomic64_set(&mcts_obj.kernel_playouts[k], 0);
+        atomic64_set(&mcts_obj.kernel_nsec[k], 0);
+    }
+    for (int k = 0; k < NR_MCTS_ROLLOUTS; k++) {
+        atomic64_set(&mcts_obj.rollout_playouts[k], 0);
+        atomic64_set(&mcts_obj.rollout_nsec[k], 0);
+    }
+    return 0;
+}
+
+void mcts_free(void)
+{
+    destroy_workqueue(mcts_wq);
+    mcts_wq = NULL;
+}
+
+ssize_t mcts_stats_show(char *buf)
+{
+    s64 nodes = atomic64_read(&mcts_obj.nr_alloc_nodes);
+    s64 nsec = atomic64_read(&mcts_obj.alloc_nsec);
+
+    ssize_t len = sysfs_emit(
+        buf,
+        "nodes %lld\nalloc_nsec %lld\nnsec_per_node %lld\nbytes_per_node %zu\n"
+        "peak_pool_bytes %lu\nreused_searches %lld\nreused_visits %lld\n"
+        "proven_nodes %lld\nsolved_searches %lld\nsaved_iterations %lld\n"
+        "transpositions %lld\nlive_nodes %lu\npeak_live_nodes %lu\n"
+        "capped_searches %lld\ncapped_leaves %lld\ndag_bytes %lu\n",
+        nodes, nsec, nodes ? div64_s64(nsec, nodes) : 0,
+        sizeof(struct node_stats) + sizeof(struct node_link),
+        atomic_long_read(&mcts_obj.peak_pool_bytes),
+        atomic64_read(&mcts_obj.reused_searches),
+        atomic64_read(&mcts_obj.reused_visits),
+        atomic64_read(&mcts_obj.proven_nodes),
+        atomic64_read(&mcts_obj.solved_searches),
+        atomic64_read(&mcts_obj.saved_iterations),
+        atomic64_read(&mcts_obj.transpositions), node_pool_live_nodes(),
+        node_pool_peak_nodes(), atomic64_read(&mcts_obj.capped_searches),
+        atomic64_read(&mcts_obj.capped_leaves),
+        atomic_long_read(&mcts_obj.dag_bytes));
+
+    /* Throughput per parallel mode and worker count */
+    for (int mode = 0; mode < 2; mode++) {
+        for (int k = 0; k < MCTS_MAX_WORKERS; k++) {
+            s64 playouts = atomic64_read(&mcts_obj.playouts[mode][k]);
+            s64 search_nsec = atomic64_read(&mcts_obj.search_nsec[mode][k]);
+            if (!search_nsec)
+                continue;
+            len += sysfs_emit_at(
+                buf, len, "%s_tree threads %d playouts_per_sec %lld\n",
+                mode ? "shared" : "root", k + 1,
+                div64_s64(playouts * USEC_PER_SEC,
+                          max_t(s64, search_nsec / NSEC_PER_USEC, 1)));
+        }
+    }
+
+    /* Throughput of the kernels running several playouts per leaf */
+    for (int k = 0; k < NR_PLAYOUT_KERNELS; k++) {
+        s64 playouts = atomic64_read(&mcts_obj.kernel_playouts[k]);
+        s64 kernel_nsec = atomic64_read(&mcts_obj.kernel_nsec[k]);
+        if (!kernel_nsec)
+            continue;
+        len += sysfs_emit_at(
+            buf, len, "playout_kernel %s playouts %lld playouts_per_sec %lld\n",
+            playout_kernel_names[k], playouts,
+            div64_s64(playouts * USEC_PER_SEC,
+                      max_t(s64, kernel_nsec / NSEC_PER_USEC, 1)));
+    }
+
+    /* Search throughput per rollout policy */
+    for (int k = 0; k < NR_MCTS_ROLLOUTS; k++) {
+        s64 playouts = atomic64_read(&mcts_obj.rollout_playouts[k]);
+        s64 rollout_nsec = atomic64_read(&mcts_obj.rollout_nsec[k]);
+        if (!rollout_nsec)
+            continue;
+        len += sysfs_emit_at(
+            buf, len, "rollout %s playouts %lld playouts_per_sec %lld\n",
+            mcts_rollout_names[k], playouts,
+            div64_s64(playouts * USEC_PER_SEC,
+                      max_t(s64, rollout_nsec / NSEC_PER_USEC, 1)));
+    }
+    return len;
 }
@@ -1,13 +1,55 @@
 #pragma once
 
+#include <linux/atomic.h>
+#include <linux/spinlock.h>
+
+#include "playout.h"
 #include "xoroshiro.h"
 
 #define ITERATIONS 100000
+#define MCTS_MAX_WORKERS 64
+
+enum mcts_rollout {
+    MCTS_ROLLOUT_RANDOM,   /* uniformly random moves */
+    MCTS_ROLLOUT_TACTICAL, /* immediate wins, then forced blocks */
+    NR_MCTS_ROLLOUTS,
+};
 
 struct mcts_info {
-    struct state_array xoro_obj;
-    int nr_active_nodes;
+    struct state_array xoro_obj; /* split into per-search streams */
+    spinlock_t xoro_lock;
+    atomic64_t nr_alloc_nodes;     /* nodes handed out by the pools */
+    atomic64_t alloc_nsec;         /* time spent growing the pools */
+    atomic_long_t peak_pool_bytes; /* largest single search */
+    atomic_long_t dag_bytes;       /* transposition tables in use */
+    atomic64_t reused_searches;    /* searches started from a kept subtree */
+    atomic64_t reused_visits;      /* visits those subtrees brought along */
+    atomic64_t proven_nodes;       /* nodes settled by the solver */
+    atomic64_t solved_searches;    /* searches stopped by a proven root */
+    atomic64_t saved_iterations;   /* iterations those searches skipped */
+    atomic64_t transpositions;     /* leaves turned into aliases */
+    atomic64_t capped_searches;    /* searches that ran out of nodes */
+    atomic64_t capped_leaves;      /* leaves they could not expand */
+    /* [root-parallel, shared tree][workers - 1] */
+    atomic64_t playouts[2][MCTS_MAX_WORKERS];
+    atomic64_t search_nsec[2][MCTS_MAX_WORKERS];
+    /* playouts run in batches, per kernel */
+    atomic64_t kernel_playouts[NR_PLAYOUT_KERNELS];
+    atomic64_t kernel_nsec[NR_PLAYOUT_KERNELS];
+    /* playouts of the searches, per rollout policy */
+    atomic64_t rollout_playouts[NR_MCTS_ROLLOUTS];
+    atomic64_t rollout_nsec[NR_MCTS_ROLLOUTS];
 };
 
-int mcts(const char *table, char player);
-void mcts_init(void);
+struct mcts_tree;
+
+struct mcts_tree *mcts_tree_alloc(void);
+void mcts_tree_free(struct mcts_tree *tree);
+void mcts_tree_release(struct mcts_tree *tree);
+int mcts(struct mcts_tree *tree,
+         const char *table,
+         char player,
+         unsigned int game);
+int mcts_init(void);
+void mcts_free(void);
+ssize_t mcts_stats_show(char *buf);
@@ -1,99 +1,519 @@
+#include <linux/completion.h>
+#include <linux/err.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/moduleparam.h>
+#include <linux/sched.h>
 #include <linux/slab.h>
-#include <linux/sort.h>
 #include <linux/string.h>
+#include <linux/sysfs.h>
 
+#include "bitboard.h"
+#include "cpu_budget.h"
 #include "game.h"
 #include "negamax.h"
-#include "util.h"
+#include "result_cache.h"
+#include "tablebase.h"
 #include "zobrist.h"
 
+/* make EVAL_CHECK=1 cross-checks the incremental evaluation */
+#ifndef EVAL_CHECK
+#define EVAL_CHECK 0
+#endif
+
+#if EVAL_CHECK
+#include "util.h"
+#endif
+
+/* Depth searched when negamax_budget_ns is 0 */
 #define MAX_SEARCH_DEPTH 6
+#define NEGAMAX_INF 100000
+
+/* Iterative deepening runs until the per-move budget is spent, polling the
+ * clock every NEGAMAX_CLOCK_NODES nodes. An iteration cut short is thrown away
+ * and the move of the last completed one is played. From the second iteration
+ * on, the search starts with a window of ASPIRATION_DELTA around the previous
+ * score and widens it fourfold on every failure.
+ */
+#define NEGAMAX_CLOCK_NODES 1024
+#define ASPIRATION_DELTA 32
+
+static unsigned long negamax_budget_ns = 10 * NSEC_PER_MSEC;
+module_param(negamax_budget_ns, ulong, 0644);
+MODULE_PARM_DESC(negamax_budget_ns,
+                 "Time per negamax move in nanoseconds (0: fixed depth 6)");
+
+static bool negamax_tablebase = true;
+module_param(negamax_tablebase, bool, 0644);
+MODULE_PARM_DESC(negamax_tablebase,
+                 "Play positions the loaded tablebase covers without searching");
+
+/* Everything a search writes, so games can search concurrently. Apart from
+ * this, searches only share the read-only zobrist keys and the lockless
+ * transposition table.
+ */
+struct negamax_ctx {
+    struct bitboard board;
+    struct bb_eval eval; /* kept in step with board */
+    /* zobrist keys of board and its symmetric images */
+    struct zobrist_keys keys;
+    u64 deadline;        /* ktime_get_ns() to stop at, 0 for none */
+    unsigned int nodes;  /* searched, to poll the clock */
+    bool aborted;        /* the deadline passed mid-iteration */
+    int depth;           /* of the last completed iteration */
+    int researches;      /* aspiration windows that failed */
+    int ply;             /* moves played since the root */
+    const bool *stop;    /* helpers: set once the result is no longer wanted */
+    unsigned int skew;   /* helpers: rotation applied to the move ordering */
+    int history_score_sum[N_GRIDS];
+    int history_count[N_GRIDS];
+    int killers[N_GRIDS][2]; /* [ply], moves that last caused a cutoff */
+};
+
+/* Lazy SMP: helper kthreads run the same iterative deepening as the main
+ * search, each with its move ordering rotated differently, and fill the shared
+ * transposition table with results the main search then cuts off on. Only
+ * the main search gives the answer, and the helpers are stopped once it has.
+ * The helpers are started once at load time and sleep between searches. A
+ * search only wakes as many as there are CPUs no search of any game uses.
+ */
+#define NEGAMAX_MAX_HELPERS 16
+
+static unsigned int negamax_helpers;
+module_param(negamax_helpers, uint, 0644);
+MODULE_PARM_DESC(negamax_helpers,
+                 "Lazy-SMP helper threads per negamax search (0: off)");
+
+struct negamax_helper {
+    struct task_struct *task;
+    struct negamax_ctx ctx;
+    char player;
+    int max_depth;
+    bool queued;             /* ctx holds a search to run */
+    struct completion done;  /* of the queued search */
+};
 
-static int history_score_sum[N_GRIDS];
-static int history_count[N_GRIDS];
+static struct negamax_helper helper_pool[NEGAMAX_MAX_HELPERS];
+static unsigned int nr_pool_helpers;
+static unsigned long idle_helpers; /* bitmap over helper_pool */
 
-static u64 hash_value;
+/* [helpers] */
+static atomic64_t nr_searches[NEGAMAX_MAX_HELPERS + 1];
+static atomic64_t search_nsec[NEGAMAX_MAX_HELPERS + 1];
+static atomic64_t depth_reached[NEGAMAX_MAX_HELPERS + 1];
 
-static int cmp_moves(const void *a, const void *b)
+static atomic64_t nr_nodes;
+static atomic64_t nr_aborted;    /* searches cut short by the deadline */
+static atomic64_t nr_researches; /* failed aspiration windows */
+static atomic64_t nr_tablebase;  /* moves answered by the tablebase */
+
+static inline bool negamax_stopped(const struct negamax_ctx *ctx)
+{
+    return ctx->aborted || (ctx->stop && READ_ONCE(*ctx->stop));
+}
+
+static inline void negamax_poll(struct negamax_ctx *ctx)
 {
-    const int *_a = (int *) a, *_b = (int *) b;
-    int score_a = 0, score_b = 0;
+    if (!(++ctx->nodes % NEGAMAX_CLOCK_NODES) && ctx->deadline &&
+        ktime_get_ns() > ctx->deadline)
+        ctx->aborted = true;
+}
 
-    if (history_count[*_a])
-        score_a = history_score_sum[*_a] / history_count[*_a];
-    if (history_count[*_b])
-        score_b = history_score_sum[*_b] / history_count[*_b];
-    return score_b - score_a;
+/* Whether the average history score of @a beats that of @b, compared by
+ * cross-multiplying. A move never searched averages 0.
+ */
+static inline bool history_before(const struct negamax_ctx *ctx, int a, int b)
+{
+    s64 sum_a = ctx->history_score_sum[a], sum_b = ctx->history_score_sum[b];
+    int count_a = max(ctx->history_count[a], 1);
+    int count_b = max(ctx->history_count[b], 1);
+    return sum_a * count_b > sum_b * count_a;
+}
+
+/* Move @move, if present in @moves[first..n_moves), to @first */
+static int promote_move(int *moves, int first, int n_moves, int move)
+{
+    for (int i = first; i < n_moves && move >= 0; i++) {
+        if (moves[i] == move) {
+            memmove(&moves[first + 1], &moves[first],
+                    (i - first) * sizeof(int));
+            moves[first] = move;
+            return first + 1;
+        }
+    }
+    return first;
+}
+
+/* Search order: the best move of an earlier search of this position, the
+ * killer moves of this ply, then the rest by decreasing history average.
+ * The moves come in ascending order and few enough for an insertion sort.
+ */
+static void order_moves(const struct negamax_ctx *ctx,
+                        int *moves,
+                        int n_moves,
+                        int tt_move)
+{
+    int first = promote_move(moves, 0, n_moves, tt_move);
+    for (int k = 0; k < 2; k++)
+        first = promote_move(moves, first, n_moves, ctx->killers[ctx->ply][k]);
+
+    for (int i = first + 1; i < n_moves; i++) {
+        int move = moves[i], j = i;
+        for (; j > first && history_before(ctx, move, moves[j - 1]); j--)
+            moves[j] = moves[j - 1];
+        moves[j] = move;
+    }
+
+    /* Helpers rotate the history-ordered part */
+    int n = n_moves - first;
+    if (ctx->skew && n > 1) {
+        int skewed[N_GRIDS], k = ctx->skew % n;
+        memcpy(skewed, &moves[first], k * sizeof(int));
+        memmove(&moves[first], &moves[first + k], (n - k) * sizeof(int));
+        memcpy(&moves[n_moves - k], skewed, k * sizeof(int));
+    }
+}
+
+static void store_killer(struct negamax_ctx *ctx, int move)
+{
+    int *killers = ctx->killers[ctx->ply];
+    if (killers[0] != move) {
+        killers[1] = killers[0];
+        killers[0] = move;
+    }
+}
+
+static void negamax_play(struct negamax_ctx *ctx, int move, char player)
+{
+    bb_play(&ctx->board, move, player);
+    bb_eval_play(&ctx->eval, move, player);
+    zobrist_keys_play(&ctx->keys, move, player);
+    ctx->ply++;
+}
+
+static void negamax_undo(struct negamax_ctx *ctx, int move, char player)
+{
+    bb_play(&ctx->board, move, player);
+    bb_eval_undo(&ctx->eval, move, player);
+    zobrist_keys_play(&ctx->keys, move, player);
+    ctx->ply--;
+}
+
+#if EVAL_CHECK
+/* Compare the incremental evaluation with a full rescan of the table */
+static void negamax_check_eval(const struct negamax_ctx *ctx, char player)
+{
+    char table[N_GRIDS];
+    for (int i = 0; i < N_GRIDS; i++) {
+        table[i] = ' ';
+        if (ctx->board.pieces[0] & BB_CELL(i))
+            table[i] = 'O';
+        else if (ctx->board.pieces[1] & BB_CELL(i))
+            table[i] = 'X';
+    }
+    WARN_ONCE(bb_eval_score(&ctx->eval, player) != get_score(table, player),
+              "kxo: incremental score %d, get_score() %d\n",
+              bb_eval_score(&ctx->eval, player), get_score(table, player));
+    WARN_ONCE(bb_eval_winner(&ctx->eval, &ctx->board) != check_win(table),
+              "kxo: incremental winner '%c', check_win() '%c'\n",
+              bb_eval_winner(&ctx->eval, &ctx->board), check_win(table));
 }
+#endif
 
-static move_t negamax(char *table, int depth, char player, int alpha, int beta)
+static move_t negamax(struct negamax_ctx *ctx,
+                      int depth,
+                      char player,
+                      int alpha,
+                      int beta)
 {
-    if (check_win(table) != ' ' || depth == 0) {
-        move_t result = {get_score(table, player), -1};
+    struct bitboard *board = &ctx->board;
+    negamax_poll(ctx);
+    if (negamax_stopped(ctx))
+        return (move_t){0, -1};
+#if EVAL_CHECK
+    negamax_check_eval(ctx, player);
+#endif
+    if (bb_eval_winner(&ctx->eval, board) != ' ' || depth == 0) {
+        move_t result = {bb_eval_score(&ctx->eval, player), -1};
         return result;
     }
-    const zobrist_entry_t *entry = zobrist_get(hash_value);
-    if (entry)
-        return (move_t){.score = entry->score, .move = entry->move};
+    /* Positions equal up to symmetry share their entry, which holds the
+     * move in the canonical orientation.
+     */
+    zobrist_entry_t entry;
+    int sym, tt_move = -1;
+    u64 key = zobrist_canonical(&ctx->keys, &sym);
+    if (zobrist_get(key, &entry)) {
+        tt_move = zobrist_from_canonical(sym, entry.move);
+        if (entry.depth >= depth &&
+            (entry.bound == TT_EXACT ||
+             (entry.bound == TT_LOWER && entry.score >= beta) ||
+             (entry.bound == TT_UPPER && entry.score <= alpha)))
+            return (move_t){.score = entry.score, .move = tt_move};
+    }
 
-    int score;
+    int score, alpha_orig = alpha;
     move_t best_move = {-10000, -1};
-    int *moves = available_moves(table);
-    int n_moves = 0;
-    while (n_moves < N_GRIDS && moves[n_moves] != -1)
-        ++n_moves;
+    int moves[N_GRIDS];
+    int n_moves = bb_moves(board, moves);
 
-    sort(moves, n_moves, sizeof(int), cmp_moves, NULL);
+    order_moves(ctx, moves, n_moves, tt_move);
 
     for (int i = 0; i < n_moves; i++) {
-        table[moves[i]] = player;
-        hash_value ^= zobrist_table[moves[i]][player == 'X'];
+        negamax_play(ctx, moves[i], player);
         if (!i)
-            score = -negamax(table, depth - 1, player == 'X' ? 'O' : 'X', -beta,
+            score = -negamax(ctx, depth - 1, player == 'X' ? 'O' : 'X', -beta,
                              -alpha)
                          .score;
         else {
-            score = -negamax(table, depth - 1, player == 'X' ? 'O' : 'X',
+            score = -negamax(ctx, depth - 1, player == 'X' ? 'O' : 'X',
                              -alpha - 1, -alpha)
                          .score;
             if (alpha < score && score < beta)
-                score = -negamax(table, depth - 1, player == 'X' ? 'O' : 'X',
+                score = -negamax(ctx, depth - 1, player == 'X' ? 'O' : 'X',
                                  -beta, -score)
                              .score;
         }
-        history_count[moves[i]]++;
-        history_score_sum[moves[i]] += score;
+        negamax_undo(ctx, moves[i], player);
+        /* An aborted search has nothing worth storing, nor a score to learn
+         * from
+         */
+        if (negamax_stopped(ctx))
+            return best_move;
+        ctx->history_count[moves[i]]++;
+        ctx->history_score_sum[moves[i]] += score;
         if (score > best_move.score) {
             best_move.score = score;
             best_move.move = moves[i];
         }
-        table[moves[i]] = ' ';
-        hash_value ^= zobrist_table[moves[i]][player == 'X'];
         if (score > alpha)
             alpha = score;
-        if (alpha >= beta)
+        if (alpha >= beta) {
+            store_killer(ctx, moves[i]);
             break;
+        }
     }
 
-    kfree((char *) moves);
-    zobrist_put(hash_value, best_move.score, best_move.move);
+    enum tt_bound bound = TT_EXACT;
+    if (best_move.score <= alpha_orig)
+        bound = TT_UPPER;
+    else if (best_move.score >= beta)
+        bound = TT_LOWER;
+    zobrist_put(key, best_move.score, zobrist_to_canonical(sym, best_move.move),
+                depth, bound);
     return best_move;
 }
 
-void negamax_init(void)
+/* Deepen two plies at a time until @max_depth is covered or the search is
+ * stopped, and return the result of the last completed iteration. The first
+ * iteration always completes, the deadline only applies after it.
+ */
+static move_t negamax_deepen(struct negamax_ctx *ctx,
+                             char player,
+                             int max_depth,
+                             u64 deadline)
+{
+    move_t result = negamax(ctx, 2, player, -NEGAMAX_INF, NEGAMAX_INF);
+    ctx->depth = 2;
+    ctx->deadline = deadline;
+
+    for (int depth = 4; ctx->depth < max_depth; depth += 2) {
+        int delta = ASPIRATION_DELTA;
+        int alpha = result.score - delta, beta = result.score + delta;
+        while (1) {
+            move_t r = negamax(ctx, depth, player, alpha, beta);
+            if (negamax_stopped(ctx))
+                return result;
+            delta *= 4;
+            if (r.score <= alpha) {
+                alpha = max(r.score - delta, -NEGAMAX_INF);
+            } else if (r.score >= beta) {
+                beta = min(r.score + delta, NEGAMAX_INF);
+            } else {
+                result = r;
+                break;
+            }
+            ctx->researches++;
+        }
+        ctx->depth = depth;
+    }
+    return result;
+}
+
+static int negamax_helper_func(void *data)
+{
+    struct negamax_helper *h = data;
+    while (!kthread_should_stop()) {
+        set_current_state(TASK_INTERRUPTIBLE);
+        if (!smp_load_acquire(&h->queued) && !kthread_should_stop())
+            schedule();
+        __set_current_state(TASK_RUNNING);
+        if (!smp_load_acquire(&h->queued))
+            continue;
+        negamax_deepen(&h->ctx, h->player, h->max_depth, 0);
+        WRITE_ONCE(h->queued, false);
+        complete(&h->done);
+    }
+    return 0;
+}
+
+/* Take up to negamax_helpers idle helpers, each on a CPU no search uses.
+ * Returns how many were put in @claimed.
+ */
+static unsigned int negamax_claim_helpers(struct negamax_helper **claimed)
+{
+    unsigned int want =
+        cpu_budget_claim(min(READ_ONCE(negamax_helpers), nr_pool_helpers));
+
+    unsigned int n = 0;
+    for (unsigned int k = 0; k < nr_pool_helpers && n < want; k++)
+        if (test_and_clear_bit(k, &idle_helpers))
+            claimed[n++] = &helper_pool[k];
+    cpu_budget_put(want - n);
+    return n;
+}
+
+/* Wait for @h to give up its search, and hand it back to the pool */
+static void negamax_release_helper(struct negamax_helper *h)
 {
-    zobrist_init();
-    hash_value = 0;
+    wait_for_completion(&h->done);
+    set_bit(h - helper_pool, &idle_helpers);
+    cpu_budget_put(1);
+}
+
+int negamax_init(void)
+{
+    for (int k = 0; k <= NEGAMAX_MAX_HELPERS; k++) {
+        atomic64_set(&nr_searches[k], 0);
+        atomic64_set(&search_nsec[k], 0);
+        atomic64_set(&depth_reached[k], 0);
+    }
+    atomic64_set(&nr_nodes, 0);
+    atomic64_set(&nr_aborted, 0);
+    atomic64_set(&nr_researches, 0);
+    atomic64_set(&nr_tablebase, 0);
+    int ret = zobrist_init();
+    if (ret)
+        return ret;
+
+    /* Helpers beyond the other CPUs would never be woken */
+    unsigned int n = min_t(unsigned int, num_online_cpus() - 1,
+                           NEGAMAX_MAX_HELPERS);
+    for (nr_pool_helpers = 0; nr_pool_helpers < n; nr_pool_helpers++) {
+        struct negamax_helper *h = &helper_pool[nr_pool_helpers];
+        init_completion(&h->done);
+        h->task = kthread_run(negamax_helper_func, h, "kxo_negamax/%u",
+                              nr_pool_helpers);
+        if (IS_ERR(h->task))
+            break;
+        set_bit(nr_pool_helpers, &idle_helpers);
+    }
+    return 0;
+}
+
+void negamax_free(void)
+{
+    for (unsigned int k = 0; k < nr_pool_helpers; k++)
+        kthread_stop(helper_pool[k].task);
+    nr_pool_helpers = 0;
+    idle_helpers = 0;
+    zobrist_free();
 }
 
 move_t negamax_predict(char *table, char player)
 {
-    memset(history_score_sum, 0, sizeof(history_score_sum));
-    memset(history_count, 0, sizeof(history_count));
+    struct negamax_ctx ctx = {0};
+    ktime_t start = ktime_get();
+    u64 budget = READ_ONCE(negamax_budget_ns);
+    bb_from_table(&ctx.board, table);
+
+    /* Covered positions need no search. A win scores a completed segment */
+    int tb_move, tb_value;
+    if (READ_ONCE(negamax_tablebase) &&
+        tablebase_get(&ctx.board, player, &tb_move, &tb_value)) {
+        atomic64_inc(&nr_tablebase);
+        return (move_t){line_weights[GOAL] * (tb_value - TB_DRAW), tb_move};
+    }
+
     move_t result;
-    for (int depth = 2; depth <= MAX_SEARCH_DEPTH; depth += 2) {
-        result = negamax(table, depth, player, -100000, 100000);
-        zobrist_clear();
+    if (result_cache_get(RESULT_NEGAMAX, table, player, budget, &result.move,
+                         &result.score))
+        return result;
+
+    memset(ctx.killers, -1, sizeof(ctx.killers));
+    bb_eval_init(&ctx.eval, &ctx.board);
+    /* Keyed by the actual position, so entries of earlier moves still apply */
+    for (int i = 0; i < N_GRIDS; i++)
+        if (table[i] != ' ')
+            zobrist_keys_play(&ctx.keys, i, table[i]);
+    zobrist_new_search();
+    cpu_budget_take(1);
+
+    /* With a budget, stop once every remaining move is covered */
+    int max_depth = MAX_SEARCH_DEPTH;
+    u64 deadline = 0;
+    if (budget) {
+        max_depth = bb_popcount(bb_empty(&ctx.board));
+        deadline = ktime_to_ns(start) + budget;
     }
+
+    bool stop = false;
+    struct negamax_helper *helpers[NEGAMAX_MAX_HELPERS];
+    unsigned int n = negamax_claim_helpers(helpers);
+    for (unsigned int k = 0; k < n; k++) {
+        struct negamax_helper *h = helpers[k];
+        h->ctx = ctx;
+        h->ctx.stop = &stop;
+        h->ctx.skew = k + 1;
+        h->player = player;
+        h->max_depth = max_depth;
+        reinit_completion(&h->done);
+        smp_store_release(&h->queued, true);
+        wake_up_process(h->task);
+    }
+
+    result = negamax_deepen(&ctx, player, max_depth, deadline);
+
+    WRITE_ONCE(stop, true);
+    for (unsigned int k = 0; k < n; k++)
+        negamax_release_helper(helpers[k]);
+    cpu_budget_put(1);
+
+    atomic64_inc(&nr_searches[n]);
+    atomic64_add(ktime_to_ns(ktime_sub(ktime_get(), start)), &search_nsec[n]);
+    atomic64_add(ctx.depth, &depth_reached[n]);
+    if (ctx.aborted)
+        atomic64_inc(&nr_aborted);
+    atomic64_add(ctx.researches, &nr_researches);
+    atomic64_add(ctx.nodes, &nr_nodes);
+    result_cache_put(RESULT_NEGAMAX, table, player, budget, result.move,
+                     result.score);
     return result;
 }
+
+ssize_t negamax_stats_show(char *buf)
+{
+    ssize_t len = sysfs_emit(buf,
+                             "tablebase %lld\nnodes %lld\naborted %lld\n"
+                             "aspiration_researches %lld\n",
+                             atomic64_read(&nr_tablebase),
+                             atomic64_read(&nr_nodes),
+                             atomic64_read(&nr_aborted),
+                             atomic64_read(&nr_researches));
+
+    /* Depth reached per second of search, per helper count */
+    for (int k = 0; k <= NEGAMAX_MAX_HELPERS; k++) {
+        s64 searches = atomic64_read(&nr_searches[k]);
+        s64 nsec = atomic64_read(&search_nsec[k]);
+        s64 depth = atomic64_read(&depth_reached[k]);
+        if (!nsec)
+            continue;
+        len += sysfs_emit_at(
+            buf, len, "helpers %d searches %lld depth_per_sec %lld\n", k,
+            searches,
+            div64_s64(depth * USEC_PER_SEC,
+                      max_t(s64, nsec / NSEC_PER_USEC, 1)));
+    }
+    return len;
+}
@@ -1,8 +1,12 @@
 #pragma once
 
+#include <linux/types.h>
+
 typedef struct {
     int score, move;
 } move_t;
 
-void negamax_init(void);
+int negamax_init(void);
+void negamax_free(void);
 move_t negamax_predict(char *table, char player);
+ssize_t negamax_stats_show(char *buf);
@@ -0,0 +1,118 @@
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/moduleparam.h>
+#include <linux/slab.h>
+
+#include "node_pool.h"
+
+/* Every pool of every game draws its segments from one module-wide budget.
+ * The segment holding the root of a pool is always granted, so a search can
+ * still pick a move when the budget is spent, and every later one is refused
+ * once the nodes of all live segments would exceed it.
+ */
+static unsigned long mcts_max_total_nodes;
+module_param(mcts_max_total_nodes, ulong, 0644);
+MODULE_PARM_DESC(mcts_max_total_nodes,
+                 "MCTS nodes all games may hold at once, counted in whole "
+                 "pool segments (0: no limit)");
+
+static atomic_long_t live_nodes;
+static atomic_long_t peak_nodes;
+
+struct node_pool *node_pool_create(unsigned int max_nodes)
+{
+    struct node_pool *pool = kzalloc(sizeof(struct node_pool), GFP_KERNEL);
+    if (pool)
+        pool->max_nodes = min_t(unsigned int, max_nodes,
+                                POOL_MAX_SEGMENTS * POOL_SEGMENT_NODES);
+    return pool;
+}
+
+void node_pool_destroy(struct node_pool *pool)
+{
+    if (!pool)
+        return;
+    for (int i = 0; i < POOL_MAX_SEGMENTS; i++)
+        kvfree(pool->segments[i]);
+    atomic_long_sub(atomic_read(&pool->nr_segments) * POOL_SEGMENT_NODES,
+                    &live_nodes);
+    kfree(pool);
+}
+
+/* Take a segment from the module-wide budget, or refuse it */
+static bool node_pool_charge(unsigned int i)
+{
+    unsigned long limit = READ_ONCE(mcts_max_total_nodes);
+    long live = atomic_long_add_return(POOL_SEGMENT_NODES, &live_nodes);
+
+    if (i && limit && (unsigned long) live > limit) {
+        atomic_long_sub(POOL_SEGMENT_NODES, &live_nodes);
+        return false;
+    }
+
+    long peak = atomic_long_read(&peak_nodes);
+    while (live > peak) {
+        long old = atomic_long_cmpxchg(&peak_nodes, peak, live);
+        if (old == peak)
+            break;
+        peak = old;
+    }
+    return true;
+}
+
+static bool node_pool_grow(struct node_pool *pool, unsigned int i)
+{
+    if (!node_pool_charge(i))
+        return false;
+    ktime_t start = ktime_get();
+    struct node_segment *seg = kvmalloc(sizeof(*seg), GFP_KERNEL);
+    atomic64_add(ktime_to_ns(ktime_sub(ktime_get(), start)),
+                 &pool->alloc_nsec);
+    if (!seg) {
+        atomic_long_sub(POOL_SEGMENT_NODES, &live_nodes);
+        return false;
+    }
+    /* Another worker of a shared tree may have beaten us to it */
+    if (cmpxchg(&pool->segments[i], NULL, seg)) {
+        atomic_long_sub(POOL_SEGMENT_NODES, &live_nodes);
+        kvfree(seg);
+    } else {
+        atomic_inc(&pool->nr_segments);
+    }
+    return true;
+}
+
+/* Reserve @count consecutive nodes and return the first index, or NODE_NONE
+ * when the pool is exhausted or over budget. Safe against concurrent callers.
+ */
+u32 node_pool_reserve(struct node_pool *pool, unsigned int count)
+{
+    int first, old = atomic_read(&pool->next);
+    do {
+        first = old;
+        /* A range never straddles two segments */
+        if ((first & POOL_SEGMENT_MASK) + count > POOL_SEGMENT_NODES)
+            first = ALIGN(first, POOL_SEGMENT_NODES);
+        if (first + count > READ_ONCE(pool->max_nodes))
+            return NODE_NONE;
+    } while (!atomic_try_cmpxchg(&pool->next, &old, first + count));
+
+    unsigned int i = first >> POOL_SEGMENT_SHIFT;
+    if (!READ_ONCE(pool->segments[i]) && !node_pool_grow(pool, i)) {
+        /* Refuse the rest of the search at once instead of asking again */
+        WRITE_ONCE(pool->max_nodes, i << POOL_SEGMENT_SHIFT);
+        return NODE_NONE;
+    }
+    return first;
+}
+
+/* Nodes in the segments of every live pool, and the most there ever were */
+unsigned long node_pool_live_nodes(void)
+{
+    return atomic_long_read(&live_nodes);
+}
+
+unsigned long node_pool_peak_nodes(void)
+{
+    return atomic_long_read(&peak_nodes);
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <linux/atomic.h>
+#include <linux/compiler.h>
+#include <linux/types.h>
+
+#include "game.h"
+
+/* MCTS nodes live in a pool of large contiguous segments and refer to each
+ * other by 32-bit index. The statistics read by every selection step are kept
+ * apart from the tree structure, and the children of a node always occupy a
+ * consecutive range of indices inside one segment, so scoring them walks one
+ * dense array.
+ */
+#define NODE_NONE U32_MAX
+#define NODE_ROOT 0U
+
+#define NODE_COUNT_BITS 7
+#define NODE_COUNT_MASK ((1U << NODE_COUNT_BITS) - 1)
+#define NODE_MOVE_MASK 0x7f
+#define NODE_PLAYER_X 0x80
+/* In children: the node is a transposition of this other node, which holds
+ * the statistics and children of the position
+ */
+#define NODE_ALIAS (1U << 31)
+
+#define POOL_SEGMENT_SHIFT 14
+#define POOL_SEGMENT_NODES (1U << POOL_SEGMENT_SHIFT)
+#define POOL_SEGMENT_MASK (POOL_SEGMENT_NODES - 1)
+#define POOL_MAX_SEGMENTS 256
+
+/* Outcome proven for the player who moved into a node. Proven values are
+ * ordered from worst to best, and NODE_WIN + NODE_LOSS - v flips the side.
+ */
+enum node_proof {
+    NODE_UNPROVEN,
+    NODE_LOSS,
+    NODE_DRAW,
+    NODE_WIN,
+};
+
+struct node_stats {
+    atomic_t n_visits;
+    atomic_t score; /* fixed_point_t, atomic for the shared-tree search */
+};
+
+struct node_link {
+    /* first child << NODE_COUNT_BITS | count, 0 if a leaf, or
+     * NODE_ALIAS | node
+     */
+    u32 children;
+    u32 parent;
+    u8 move; /* grid moved into, | NODE_PLAYER_X when X is to move here */
+    u8 proof; /* enum node_proof */
+};
+
+struct node_segment {
+    struct node_stats stats[POOL_SEGMENT_NODES];
+    struct node_link links[POOL_SEGMENT_NODES];
+};
+
+struct node_pool {
+    atomic_t next; /* indices handed out, including wasted ones */
+    unsigned int max_nodes; /* indices the search may hand out */
+    atomic_t nr_segments;
+    atomic64_t alloc_nsec;
+    struct node_segment *segments[POOL_MAX_SEGMENTS];
+};
+
+struct node_pool *node_pool_create(unsigned int max_nodes);
+void node_pool_destroy(struct node_pool *pool);
+u32 node_pool_reserve(struct node_pool *pool, unsigned int count);
+unsigned long node_pool_live_nodes(void);
+unsigned long node_pool_peak_nodes(void);
+
+static inline struct node_stats *node_stats(const struct node_pool *pool,
+                                            u32 idx)
+{
+    struct node_segment *seg =
+        READ_ONCE(pool->segments[idx >> POOL_SEGMENT_SHIFT]);
+    return &seg->stats[idx & POOL_SEGMENT_MASK];
+}
+
+static inline struct node_link *node_link(const struct node_pool *pool,
+                                          u32 idx)
+{
+    struct node_segment *seg =
+        READ_ONCE(pool->segments[idx >> POOL_SEGMENT_SHIFT]);
+    return &seg->links[idx & POOL_SEGMENT_MASK];
+}
+
+static inline int node_move(const struct node_link *link)
+{
+    return link->move & NODE_MOVE_MASK;
+}
+
+/* The player to move at this node */
+static inline char node_player(const struct node_link *link)
+{
+    return link->move & NODE_PLAYER_X ? 'X' : 'O';
+}
+
+/* The node holding the statistics of the position @idx stands for */
+static inline u32 node_target(const struct node_pool *pool, u32 idx)
+{
+    u32 children = READ_ONCE(node_link(pool, idx)->children);
+    return children & NODE_ALIAS ? children & ~NODE_ALIAS : idx;
+}
+
+static inline u32 node_first_child(u32 children)
+{
+    return children >> NODE_COUNT_BITS;
+}
+
+static inline unsigned int node_nr_children(u32 children)
+{
+    return children & NODE_COUNT_MASK;
+}
+
+static inline unsigned long node_pool_bytes(const struct node_pool *pool)
+{
+    return atomic_read(&pool->nr_segments) * sizeof(struct node_segment);
+}
@@ -0,0 +1,190 @@
+#include <linux/bitops.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+
+#ifdef CONFIG_X86_64
+#include <asm/cpufeature.h>
+#include <asm/fpu/api.h>
+#endif
+
+#include "playout.h"
+
+const char *const playout_kernel_names[NR_PLAYOUT_KERNELS] = {
+    [PLAYOUT_SCALAR] = "scalar",
+    [PLAYOUT_BITSLICE] = "bitslice",
+    [PLAYOUT_AVX2] = "avx2",
+};
+
+/* @wanted is 0 for the widest kernel the CPU runs, or a kernel plus one. The
+ * AVX2 kernel falls back to the 64-lane one without AVX2.
+ */
+enum playout_kernel playout_kernel_select(unsigned int wanted)
+{
+    bool avx2 = false;
+
+#ifdef CONFIG_X86_64
+    avx2 = boot_cpu_has(X86_FEATURE_AVX2);
+#endif
+    if (!wanted || wanted > NR_PLAYOUT_KERNELS)
+        return avx2 ? PLAYOUT_AVX2 : PLAYOUT_BITSLICE;
+    if (wanted - 1 == PLAYOUT_AVX2 && !avx2)
+        return PLAYOUT_BITSLICE;
+    return wanted - 1;
+}
+
+/* Lanes of the first word in which one of the @n @segments is complete */
+static void playout_check(u64 (*own)[PLAYOUT_WORDS],
+                          const u8 *segments,
+                          int n,
+                          u64 *won)
+{
+    u64 any = 0;
+
+    for (int i = 0; i < n; i++) {
+        const u8 *cells = line_cells[segments[i]];
+        u64 all = own[cells[0]][0];
+        for (int k = 1; k < GOAL; k++)
+            all &= own[cells[k]][0];
+        if (!ALLOW_EXCEED) {
+            const u8 *ends = line_end_cells[segments[i]];
+            all &= ~(own[ends[0]][0] | own[ends[1]][0]);
+        }
+        any |= all;
+    }
+    won[0] = any;
+}
+
+/* Play @lanes games from @board, @player to move, and return the half points
+ * the player who moved into @board scores over them.
+ */
+static unsigned int playout_lanes(struct playout_lanes *pl,
+                                  enum playout_kernel kernel,
+                                  struct state_array *xoro_obj,
+                                  const struct bitboard *board,
+                                  char player,
+                                  unsigned int lanes,
+                                  const u8 *empty,
+                                  int nr_empty,
+                                  const int *nr_segments)
+{
+    unsigned int words = DIV_ROUND_UP(lanes, 64);
+    unsigned int wins[2] = {0, 0}, draws = 0;
+    u64 active[PLAYOUT_WORDS], won[PLAYOUT_WORDS];
+    int side = BB_SIDE(player);
+    u64 random = 0;
+    int nr_random = 0;
+
+    for (int s = 0; s < 2; s++) {
+        for (int cell = 0; cell <= N_GRIDS; cell++) {
+            u64 fill = cell < N_GRIDS && (board->pieces[s] & BB_CELL(cell))
+                           ? ~0ULL
+                           : 0;
+            for (int w = 0; w < PLAYOUT_WORDS; w++)
+                pl->own[s][cell][w] = fill;
+        }
+    }
+    for (unsigned int w = 0; w < PLAYOUT_WORDS; w++) {
+        if (w >= words)
+            active[w] = 0;
+        else if (lanes - 64 * w >= 64)
+            active[w] = ~0ULL;
+        else
+            active[w] = BIT_ULL(lanes - 64 * w) - 1;
+    }
+    for (unsigned int l = 0; l < lanes; l++)
+        memcpy(pl->cells[l], empty, nr_empty);
+
+    for (int t = 0; t < nr_empty; t++, side = !side) {
+        u32 left = nr_empty - t;
+        bool open = false;
+
+        /* A step of the Fisher-Yates shuffle of every lane, which draws 16
+         * random bits: the bias is at most N_GRIDS / 2^16.
+         */
+        for (unsigned int w = 0; w < words; w++) {
+            for (u64 a = active[w]; a; a &= a - 1) {
+                u8 *cells = pl->cells[64 * w + __ffs64(a)];
+                if (!nr_random) {
+                    random = xoro_next(xoro_obj);
+                    nr_random = 4;
+                }
+                u32 j = t + (((u32) (u16) random * left) >> 16);
+                random >>= 16;
+                nr_random--;
+                swap(cells[t], cells[j]);
+                pl->own[side][cells[t]][w] |= a & -a;
+            }
+        }
+
+#ifdef CONFIG_X86_64
+        if (kernel == PLAYOUT_AVX2)
+            playout_check_avx2(pl->own[side], pl->segments[side],
+                               nr_segments[side], won);
+        else
+#endif
+            playout_check(pl->own[side], pl->segments[side],
+                          nr_segments[side], won);
+
+        for (unsigned int w = 0; w < words; w++) {
+            u64 done = won[w] & active[w];
+            wins[side] += hweight64(done);
+            active[w] &= ~done;
+            open |= active[w] != 0;
+        }
+        if (!open)
+            break;
+    }
+
+    /* The lanes still playing filled the board */
+    for (unsigned int w = 0; w < words; w++)
+        draws += hweight64(active[w]);
+    return 2 * wins[!BB_SIDE(player)] + draws;
+}
+
+/* Run @n playouts from @board, @player to move, as many at a time as
+ * @kernel has lanes, and return the half points the player who moved into
+ * @board scores over them, so that 2 * @n is a win in every playout.
+ */
+unsigned int playout_run(struct playout_lanes *pl,
+                         enum playout_kernel kernel,
+                         struct state_array *xoro_obj,
+                         const struct bitboard *board,
+                         char player,
+                         unsigned int n)
+{
+    unsigned int width = kernel == PLAYOUT_AVX2 ? PLAYOUT_MAX_LANES : 64;
+    unsigned int half_points = 0;
+    int nr_segments[2] = {0, 0};
+    u8 empty[N_GRIDS];
+    int nr_empty = 0;
+
+    for (bitboard_t e = bb_empty(board); e; e &= e - 1)
+        empty[nr_empty++] = __ffs64(e);
+
+    /* A segment the opponent already has a piece on is out of reach */
+    for (int i = 0; i < N_LINE_SEGMENTS; i++) {
+        for (int s = 0; s < 2; s++) {
+            if (board->pieces[!s] & line_masks[i])
+                continue;
+            if (!ALLOW_EXCEED && (board->pieces[s] & line_ends[i]))
+                continue;
+            pl->segments[s][nr_segments[s]++] = i;
+        }
+    }
+
+    for (unsigned int done = 0; done < n; done += width) {
+        unsigned int lanes = min(n - done, width);
+#ifdef CONFIG_X86_64
+        if (kernel == PLAYOUT_AVX2) {
+            kernel_fpu_begin();
+            half_points += playout_lanes(pl, kernel, xoro_obj, board, player,
+                                         lanes, empty, nr_empty, nr_segments);
+            kernel_fpu_end();
+            continue;
+        }
+#endif
+        half_points += playout_lanes(pl, kernel, xoro_obj, board, player,
+                                     lanes, empty, nr_empty, nr_segments);
+    }
+    return half_points;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <linux/types.h>
+
+#include "bitboard.h"
+#include "xoroshiro.h"
+
+/* Batched random playouts from one position. Every lane plays a game of its
+ * own, and the boards are bit-sliced: bit l % 64 of own[side][grid][l / 64]
+ * is set when side owns the grid in lane l, so ANDing the words of the grids
+ * of a segment finds the lanes in which it is complete, all at once.
+ */
+#define PLAYOUT_WORDS 4 /* lane words of the widest kernel */
+#define PLAYOUT_MAX_LANES (64 * PLAYOUT_WORDS)
+
+enum playout_kernel {
+    PLAYOUT_SCALAR,   /* one playout after the other, no lanes */
+    PLAYOUT_BITSLICE, /* 64 lanes in general purpose registers */
+    PLAYOUT_AVX2,     /* 256 lanes in AVX2 registers */
+    NR_PLAYOUT_KERNELS,
+};
+
+/* Scratch space of one worker, too large for the stack */
+struct playout_lanes {
+    /* Grid N_GRIDS is never owned and stands for the edge of the board */
+    u64 own[2][N_GRIDS + 1][PLAYOUT_WORDS];
+    u8 cells[PLAYOUT_MAX_LANES][N_GRIDS]; /* empty grids, in playing order */
+    u8 segments[2][N_LINE_SEGMENTS];      /* those each side can still win */
+};
+
+extern const char *const playout_kernel_names[NR_PLAYOUT_KERNELS];
+
+enum playout_kernel playout_kernel_select(unsigned int wanted);
+unsigned int playout_run(struct playout_lanes *pl,
+                         enum playout_kernel kernel,
+                         struct state_array *xoro_obj,
+                         const struct bitboard *board,
+                         char player,
+                         unsigned int n);
+
+#ifdef CONFIG_X86_64
+void playout_check_avx2(u64 (*own)[PLAYOUT_WORDS],
+                        const u8 *segments,
+                        int n,
+                        u64 *won);
+#endif
@@ -0,0 +1,29 @@
+/* Built with AVX2 code generation: only call between kernel_fpu_begin() and
+ * kernel_fpu_end(), on CPUs with X86_FEATURE_AVX2.
+ */
+#include "playout.h"
+
+/* The PLAYOUT_WORDS lane words in one register, loaded unaligned */
+typedef u64 lanes_t __attribute__((vector_size(8 * PLAYOUT_WORDS), aligned(8)));
+
+/* playout_check() over all 256 lanes */
+void playout_check_avx2(u64 (*own)[PLAYOUT_WORDS],
+                        const u8 *segments,
+                        int n,
+                        u64 *won)
+{
+    lanes_t any = {0};
+
+    for (int i = 0; i < n; i++) {
+        const u8 *cells = line_cells[segments[i]];
+        lanes_t all = *(lanes_t *) own[cells[0]];
+        for (int k = 1; k < GOAL; k++)
+            all &= *(lanes_t *) own[cells[k]];
+        if (!ALLOW_EXCEED) {
+            const u8 *ends = line_end_cells[segments[i]];
+            all &= ~(*(lanes_t *) own[ends[0]] | *(lanes_t *) own[ends[1]]);
+        }
+        any |= all;
+    }
+    *(lanes_t *) won = any;
+}
@@ -0,0 +1,256 @@
+#include <linux/log2.h>
+#include <linux/math64.h>
+#include <linux/moduleparam.h>
+#include <linux/percpu.h>
+#include <linux/rcupdate.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/sysfs.h>
+
+#include "result_cache.h"
+#include "zobrist.h"
+
+/* Games started from the same opening run into the same positions over and
+ * over, so the move picked for a position is kept and handed to whichever
+ * game reaches it next, in any orientation: entries are keyed by the
+ * canonical Zobrist key and hold the canonical board, which a hit must match
+ * exactly, along with the engine, the player to move and the budget searched
+ * with. A negamax search under a deadline or an MCTS search continuing a kept
+ * tree may pick another move when run again; a hit replays the first one.
+ *
+ * The cache is set-associative with four entries to a set. Lookups only take
+ * the RCU read lock and mark the entry they hit as referenced. Inserts are
+ * serialized by a spinlock, fill empty slots first and otherwise run the
+ * second-chance CLOCK hand of the set: referenced entries lose their mark and
+ * are passed over, the first unmarked one is replaced and freed after a grace
+ * period.
+ */
+#define CACHE_SET_ENTRIES 4
+
+struct cache_entry {
+    u64 key;
+    struct bitboard board; /* in the canonical orientation */
+    u64 budget;
+    u8 engine;
+    char player;
+    s8 move; /* in the canonical orientation */
+    bool referenced;
+    int score;
+    struct rcu_head rcu;
+};
+
+struct cache_set {
+    struct cache_entry __rcu *entries[CACHE_SET_ENTRIES];
+    unsigned int hand; /* under cache_lock */
+};
+
+static bool result_cache = true;
+module_param(result_cache, bool, 0644);
+MODULE_PARM_DESC(result_cache, "Reuse moves searched for earlier games");
+
+static unsigned int result_cache_size = 4096;
+module_param(result_cache_size, uint, 0444);
+MODULE_PARM_DESC(result_cache_size,
+                 "Positions kept by the result cache, rounded down to a "
+                 "power of two");
+
+struct cache_stats {
+    u64 hits;
+    u64 misses;
+    u64 inserts;
+    u64 evictions;
+};
+
+static struct cache_set *cache;
+static unsigned long cache_mask;
+static unsigned int nr_entries; /* under cache_lock */
+static DEFINE_SPINLOCK(cache_lock);
+static DEFINE_PER_CPU(struct cache_stats, cache_stats);
+
+/* Canonical key and board of @table, and the symmetry that maps to them */
+static u64 cache_canonical(const char *table, struct bitboard *board, int *sym)
+{
+    struct zobrist_keys z = {0};
+
+    for (int i = 0; i < N_GRIDS; i++)
+        if (table[i] != ' ')
+            zobrist_keys_play(&z, i, table[i]);
+    u64 key = zobrist_canonical(&z, sym);
+
+    board->pieces[0] = board->pieces[1] = 0;
+    for (int i = 0; i < N_GRIDS; i++)
+        if (table[i] != ' ')
+            board->pieces[BB_SIDE(table[i])] |= BB_CELL(sym_cells[*sym][i]);
+    return key;
+}
+
+static bool cache_match(const struct cache_entry *e,
+                        u64 key,
+                        const struct bitboard *board,
+                        enum result_engine engine,
+                        char player,
+                        u64 budget)
+{
+    return e->key == key && e->board.pieces[0] == board->pieces[0] &&
+           e->board.pieces[1] == board->pieces[1] && e->engine == engine &&
+           e->player == player && e->budget == budget;
+}
+
+int result_cache_init(void)
+{
+    unsigned long nr_sets = max(result_cache_size / CACHE_SET_ENTRIES, 1U);
+
+    nr_sets = rounddown_pow_of_two(nr_sets);
+    cache = kvcalloc(nr_sets, sizeof(struct cache_set), GFP_KERNEL);
+    if (!cache) {
+        pr_info("kxo: Failed to allocate the result cache\n");
+        return -ENOMEM;
+    }
+    cache_mask = nr_sets - 1;
+    nr_entries = 0;
+    return 0;
+}
+
+/* @score may be NULL when the caller has no use for it */
+bool result_cache_get(enum result_engine engine,
+                      const char *table,
+                      char player,
+                      u64 budget,
+                      int *move,
+                      int *score)
+{
+    struct bitboard board;
+    bool hit = false;
+    int sym;
+
+    if (!READ_ONCE(result_cache))
+        return false;
+
+    u64 key = cache_canonical(table, &board, &sym);
+    struct cache_set *set = &cache[key & cache_mask];
+
+    rcu_read_lock();
+    for (int i = 0; i < CACHE_SET_ENTRIES; i++) {
+        struct cache_entry *e = rcu_dereference(set->entries[i]);
+        if (!e || !cache_match(e, key, &board, engine, player, budget))
+            continue;
+        if (!READ_ONCE(e->referenced))
+            WRITE_ONCE(e->referenced, true);
+        *move = zobrist_from_canonical(sym, e->move);
+        if (score)
+            *score = e->score;
+        hit = true;
+        break;
+    }
+    rcu_read_unlock();
+
+    if (hit)
+        this_cpu_inc(cache_stats.hits);
+    else
+        this_cpu_inc(cache_stats.misses);
+    return hit;
+}
+
+void result_cache_put(enum result_engine engine,
+                      const char *table,
+                      char player,
+                      u64 budget,
+                      int move,
+                      int score)
+{
+    struct cache_entry *e, *victim = NULL;
+    int sym;
+
+    if (!READ_ONCE(result_cache) || move < 0)
+        return;
+    e = kmalloc(sizeof(*e), GFP_KERNEL);
+    if (!e)
+        return;
+    e->key = cache_canonical(table, &e->board, &sym);
+    e->budget = budget;
+    e->engine = engine;
+    e->player = player;
+    e->move = zobrist_to_canonical(sym, move);
+    e->referenced = false;
+    e->score = score;
+
+    struct cache_set *set = &cache[e->key & cache_mask];
+    int slot = -1;
+
+    spin_lock(&cache_lock);
+    for (int i = 0; i < CACHE_SET_ENTRIES; i++) {
+        struct cache_entry *old =
+            rcu_dereference_protected(set->entries[i],
+                                      lockdep_is_held(&cache_lock));
+        if (!old) {
+            if (slot < 0)
+                slot = i;
+            continue;
+        }
+        /* Another game searched the same position meanwhile */
+        if (cache_match(old, e->key, &e->board, engine, player, budget)) {
+            spin_unlock(&cache_lock);
+            kfree(e);
+            return;
+        }
+    }
+    if (slot < 0) {
+        /* One sweep at most, lookups may mark the entries again behind it */
+        for (int i = 0; i < CACHE_SET_ENTRIES; i++) {
+            victim = rcu_dereference_protected(set->entries[set->hand],
+                                               lockdep_is_held(&cache_lock));
+            if (!READ_ONCE(victim->referenced))
+                break;
+            WRITE_ONCE(victim->referenced, false);
+            set->hand = (set->hand + 1) % CACHE_SET_ENTRIES;
+        }
+        slot = set->hand;
+        victim = rcu_dereference_protected(set->entries[slot],
+                                           lockdep_is_held(&cache_lock));
+        set->hand = (set->hand + 1) % CACHE_SET_ENTRIES;
+    } else {
+        nr_entries++;
+    }
+    rcu_assign_pointer(set->entries[slot], e);
+    spin_unlock(&cache_lock);
+
+    this_cpu_inc(cache_stats.inserts);
+    if (victim) {
+        this_cpu_inc(cache_stats.evictions);
+        kfree_rcu(victim, rcu);
+    }
+}
+
+/* No lookup can be running once the games are gone */
+void result_cache_free(void)
+{
+    if (!cache)
+        return;
+    for (unsigned long s = 0; s <= cache_mask; s++)
+        for (int i = 0; i < CACHE_SET_ENTRIES; i++)
+            kfree(rcu_dereference_protected(cache[s].entries[i], 1));
+    kvfree(cache);
+    cache = NULL;
+}
+
+ssize_t result_cache_stats_show(char *buf)
+{
+    struct cache_stats sum = {0};
+    int cpu;
+
+    for_each_possible_cpu(cpu) {
+        const struct cache_stats *s = per_cpu_ptr(&cache_stats, cpu);
+        sum.hits += s->hits;
+        sum.misses += s->misses;
+        sum.inserts += s->inserts;
+        sum.evictions += s->evictions;
+    }
+    u64 lookups = sum.hits + sum.misses;
+    return sysfs_emit(buf,
+                      "capacity %lu\nentries %u\nhits %llu\nmisses %llu\n"
+                      "hit_rate_permille %llu\ninserts %llu\nevictions %llu\n",
+                      (cache_mask + 1) * CACHE_SET_ENTRIES,
+                      READ_ONCE(nr_entries), sum.hits, sum.misses,
+                      lookups ? div64_u64(sum.hits * 1000, lookups) : 0,
+                      sum.inserts, sum.evictions);
+}
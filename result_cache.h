@@ -0,0 +1,27 @@
+#pragma once
+
+#include <linux/types.h>
+
+/* Moves already chosen for a position, shared by every game. A hit hands back
+ * the move of an earlier search instead of searching again.
+ */
+enum result_engine {
+    RESULT_MCTS,
+    RESULT_NEGAMAX,
+};
+
+int result_cache_init(void);
+bool result_cache_get(enum result_engine engine,
+                      const char *table,
+                      char player,
+                      u64 budget,
+                      int *move,
+                      int *score);
+void result_cache_put(enum result_engine engine,
+                      const char *table,
+                      char player,
+                      u64 budget,
+                      int move,
+                      int score);
+void result_cache_free(void);
+ssize_t result_cache_stats_show(char *buf);
@@ -0,0 +1,129 @@
+/* Solve the game from the empty board and write the perfect-play tablebase
+ * the kernel module loads with request_firmware(). Install the output under
+ * /lib/firmware/.
+ *
+ * Usage: tablebase-gen [output file]
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "game.h"
+#include "tablebase.h"
+
+#if N_GRIDS > TABLEBASE_MAX_GRIDS
+#error "The tablebase only covers boards of up to 16 grids"
+#endif
+
+static struct tablebase_index ix;
+static uint8_t *entries;
+static uint8_t *plies; /* until the game ends under perfect play */
+static char table[N_GRIDS];
+
+static uint32_t rank_table(void)
+{
+    uint64_t o = 0, x = 0;
+    for (int i = 0; i < N_GRIDS; i++) {
+        if (table[i] == 'O')
+            o |= 1ULL << i;
+        else if (table[i] == 'X')
+            x |= 1ULL << i;
+    }
+    return tablebase_rank(&ix, o, x);
+}
+
+/* Whether @value reached in @n plies beats @best reached in @best_n. Wins
+ * are taken as early as possible, losses put off as long as possible.
+ */
+static bool better(int value, int n, int best, int best_n)
+{
+    if (value != best)
+        return value > best;
+    if (value == TB_WIN)
+        return n < best_n;
+    return value == TB_LOSS && n > best_n;
+}
+
+/* Value of table for @player to move, and in @n the plies left */
+static int solve(char player, int *n)
+{
+    uint32_t idx = rank_table();
+    if (entries[idx]) {
+        *n = plies[idx];
+        return entries[idx] >> TB_VALUE_SHIFT;
+    }
+
+    int best = TB_UNKNOWN, best_n = 0, best_move = TB_NO_MOVE;
+    char win = check_win(table);
+    if (win == 'D') {
+        best = TB_DRAW;
+    } else if (win != ' ') {
+        best = TB_LOSS; /* the opponent just completed a line */
+    } else {
+        for_each_empty_grid(i, table) {
+            int child_n;
+            table[i] = player;
+            int value = TB_WIN + TB_LOSS - solve(player ^ 'O' ^ 'X', &child_n);
+            table[i] = ' ';
+
+            if (best_move == TB_NO_MOVE ||
+                better(value, child_n + 1, best, best_n)) {
+                best = value;
+                best_n = child_n + 1;
+                best_move = i;
+            }
+        }
+    }
+    entries[idx] = best << TB_VALUE_SHIFT | best_move;
+    plies[idx] = best_n;
+    *n = best_n;
+    return best;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path = argc > 1 ? argv[1] : TABLEBASE_FILE;
+
+    tablebase_index_init(&ix);
+    uint32_t nr_entries = ix.offset[N_GRIDS + 1];
+    entries = calloc(nr_entries, 1);
+    plies = calloc(nr_entries, 1);
+    if (!entries || !plies) {
+        fprintf(stderr, "Failed to allocate %u entries\n", nr_entries);
+        return 1;
+    }
+
+    int n;
+    memset(table, ' ', N_GRIDS);
+    int value = solve('O', &n);
+
+    struct tablebase_header header = {
+        .magic = TABLEBASE_MAGIC,
+        .version = TABLEBASE_VERSION,
+        .board_size = BOARD_SIZE,
+        .goal = GOAL,
+        .allow_exceed = ALLOW_EXCEED,
+        .nr_entries = nr_entries,
+        .checksum = tablebase_checksum(entries, nr_entries),
+    };
+    char block[TABLEBASE_HEADER_SIZE] = {0};
+    memcpy(block, &header, sizeof(header));
+
+    FILE *fp = fopen(path, "wb");
+    if (!fp || fwrite(block, sizeof(block), 1, fp) != 1 ||
+        fwrite(entries, nr_entries, 1, fp) != 1 || fclose(fp)) {
+        perror(path);
+        return 1;
+    }
+
+    uint32_t reachable = 0;
+    for (uint32_t i = 0; i < nr_entries; i++)
+        reachable += !!entries[i];
+    static const char *const names[] = {"unknown", "loss", "draw", "win"};
+    printf("%s: %u entries, %u reachable, first player: %s in %d plies\n",
+           path, nr_entries, reachable, names[value], n);
+    free(entries);
+    free(plies);
+    return 0;
+}
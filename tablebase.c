@@ -0,0 +1,96 @@
+#include <linux/device.h>
+#include <linux/firmware.h>
+#include <linux/moduleparam.h>
+#include <linux/string.h>
+#include <linux/vmalloc.h>
+
+#include "tablebase.h"
+
+static char *tablebase_file = TABLEBASE_FILE;
+module_param(tablebase_file, charp, 0444);
+MODULE_PARM_DESC(tablebase_file,
+                 "Firmware file holding the perfect-play tablebase");
+
+static struct tablebase_index tb_index;
+static u8 *tb_entries; /* NULL when no tablebase was loaded */
+
+static bool tablebase_valid(const struct firmware *fw)
+{
+    const struct tablebase_header *h = (const void *) fw->data;
+
+    if (fw->size < TABLEBASE_HEADER_SIZE || h->magic != TABLEBASE_MAGIC ||
+        h->version != TABLEBASE_VERSION) {
+        pr_warn("kxo: %s is not a version %d tablebase\n", tablebase_file,
+                TABLEBASE_VERSION);
+        return false;
+    }
+    if (h->board_size != BOARD_SIZE || h->goal != GOAL ||
+        h->allow_exceed != ALLOW_EXCEED ||
+        h->nr_entries != tb_index.offset[N_GRIDS + 1] ||
+        fw->size != TABLEBASE_HEADER_SIZE + h->nr_entries) {
+        pr_warn("kxo: %s was generated for another board\n", tablebase_file);
+        return false;
+    }
+    if (tablebase_checksum(fw->data + TABLEBASE_HEADER_SIZE, h->nr_entries) !=
+        h->checksum) {
+        pr_warn("kxo: %s is corrupted\n", tablebase_file);
+        return false;
+    }
+    return true;
+}
+
+/* A missing or unusable file is not an error: negamax then searches every
+ * position itself.
+ */
+void tablebase_load(struct device *dev)
+{
+    const struct firmware *fw;
+
+    if (N_GRIDS > TABLEBASE_MAX_GRIDS)
+        return;
+    tablebase_index_init(&tb_index);
+    if (request_firmware(&fw, tablebase_file, dev)) {
+        pr_info("kxo: no tablebase, negamax searches every move\n");
+        return;
+    }
+    if (tablebase_valid(fw)) {
+        size_t size = fw->size - TABLEBASE_HEADER_SIZE;
+        tb_entries = vmalloc(size);
+        if (tb_entries) {
+            memcpy(tb_entries, fw->data + TABLEBASE_HEADER_SIZE, size);
+            pr_info("kxo: loaded tablebase %s, %zu bytes\n", tablebase_file,
+                    size);
+        }
+    }
+    release_firmware(fw);
+}
+
+/* Look up the perfect-play move and the value for @player to move */
+bool tablebase_get(const struct bitboard *b,
+                   char player,
+                   int *move,
+                   int *value)
+{
+    if (!tb_entries)
+        return false;
+
+    u32 idx = tablebase_rank(&tb_index, b->pieces[0], b->pieces[1]);
+    if (idx == TABLEBASE_NONE)
+        return false;
+    u8 entry = tb_entries[idx];
+    /* The side to move follows from the piece count */
+    int n = bb_popcount(b->pieces[0] | b->pieces[1]);
+    if (!entry || (n & 1) != BB_SIDE(player))
+        return false;
+    *value = entry >> TB_VALUE_SHIFT;
+    *move = entry & TB_NO_MOVE;
+    if (*move == TB_NO_MOVE)
+        *move = -1;
+    return true;
+}
+
+void tablebase_free(void)
+{
+    vfree(tb_entries);
+    tb_entries = NULL;
+}
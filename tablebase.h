@@ -0,0 +1,115 @@
+#pragma once
+
+/* Perfect-play tablebase, shared by the kernel module and the userspace
+ * generator (tablebase-gen.c) that writes it.
+ *
+ * The file is a 64-byte header followed by one byte per position: the value
+ * of the position for the player to move in the top two bits and the best
+ * move in the low six. Positions are those with as many O pieces as X pieces,
+ * or one more, since O moves first. They are ordered by piece count, then by
+ * the rank of the set of occupied grids, then by the rank of the O pieces
+ * among those, so a position is located without searching.
+ */
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdint.h>
+#endif
+
+#include "game.h"
+
+#define TB_STR(x) #x
+#define TB_XSTR(x) TB_STR(x)
+#define TABLEBASE_FILE \
+    "kxo-" TB_XSTR(BOARD_SIZE) "x" TB_XSTR(BOARD_SIZE) "-" TB_XSTR(GOAL) ".tb"
+
+#define TABLEBASE_MAGIC 0x544f584b /* "KXOT" */
+#define TABLEBASE_VERSION 1
+#define TABLEBASE_HEADER_SIZE 64
+#define TABLEBASE_NONE 0xffffffffU
+/* Larger boards overflow the 32-bit index */
+#define TABLEBASE_MAX_GRIDS 16
+
+/* Value for the player to move. The order matches enum node_proof */
+enum tb_value {
+    TB_UNKNOWN, /* not reachable from the empty board */
+    TB_LOSS,
+    TB_DRAW,
+    TB_WIN,
+};
+
+#define TB_VALUE_SHIFT 6
+#define TB_NO_MOVE 0x3f
+
+struct tablebase_header {
+    uint32_t magic;
+    uint16_t version;
+    uint8_t board_size;
+    uint8_t goal;
+    uint8_t allow_exceed;
+    uint8_t reserved[3];
+    uint32_t nr_entries;
+    uint32_t checksum; /* tablebase_checksum() of the entries */
+};
+
+/* Positions ranked before each piece count, and binomial coefficients */
+struct tablebase_index {
+    uint32_t offset[N_GRIDS + 2];
+    uint32_t binom[N_GRIDS + 1][N_GRIDS + 1];
+};
+
+static inline void tablebase_index_init(struct tablebase_index *ix)
+{
+    for (int n = 0; n <= N_GRIDS; n++) {
+        ix->binom[n][0] = 1;
+        for (int k = 1; k <= N_GRIDS; k++)
+            ix->binom[n][k] =
+                n ? ix->binom[n - 1][k - 1] + ix->binom[n - 1][k] : 0;
+    }
+    ix->offset[0] = 0;
+    for (int k = 0; k <= N_GRIDS; k++)
+        ix->offset[k + 1] = ix->offset[k] + ix->binom[N_GRIDS][k] *
+                                                ix->binom[k][(k + 1) / 2];
+}
+
+/* Index of the position, or TABLEBASE_NONE for illegal piece counts */
+static inline uint32_t tablebase_rank(const struct tablebase_index *ix,
+                                      uint64_t o,
+                                      uint64_t x)
+{
+    uint32_t occupied_rank = 0, o_rank = 0;
+    int k = 0, n_o = 0;
+
+    for (int i = 0; i < N_GRIDS; i++) {
+        if (!((o | x) >> i & 1))
+            continue;
+        occupied_rank += ix->binom[i][++k];
+        if (o >> i & 1)
+            o_rank += ix->binom[k - 1][++n_o];
+    }
+    if (n_o != (k + 1) / 2)
+        return TABLEBASE_NONE;
+    return ix->offset[k] + occupied_rank * ix->binom[k][n_o] + o_rank;
+}
+
+/* FNV-1a */
+static inline uint32_t tablebase_checksum(const uint8_t *entries, uint32_t n)
+{
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < n; i++)
+        hash = (hash ^ entries[i]) * 16777619u;
+    return hash;
+}
+
+#ifdef __KERNEL__
+#include "bitboard.h"
+
+struct device;
+
+void tablebase_load(struct device *dev);
+bool tablebase_get(const struct bitboard *b,
+                   char player,
+                   int *move,
+                   int *value);
+void tablebase_free(void);
+#endif
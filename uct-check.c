@@ -0,0 +1,81 @@
+/* Compare the table-driven UCT of fixed.h with a double-precision UCT over
+ * the visit counts a search reaches, including the counts past the tables
+ * that take the scaled fallback. Exits non-zero when the error exceeds
+ * MAX_ERROR.
+ *
+ * Usage: uct-check [max parent visits]
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "fixed.h"
+
+#define MAX_ERROR 0.00075
+#define N_SCORES 9
+
+static double max_error;
+static u32 worst_parent, worst_n;
+static fixed_point_t worst_score;
+
+static void check(u32 parent, u32 factor, u32 n, fixed_point_t score)
+{
+    double mean = (double) score / (1U << FIXED_SCALE_BITS) / n;
+    double expected = mean + sqrt(2.0 * log(parent) / n);
+    double got = (double) uct_value(factor, n, score) / (1U << UCT_SCALE_BITS);
+    double error = fabs(got - expected);
+    if (error > max_error) {
+        max_error = error;
+        worst_parent = parent;
+        worst_n = n;
+        worst_score = score;
+    }
+}
+
+/* Every reward is in [0, 1], so the child score sum is in [0, n] */
+static void check_child(u32 parent, u32 factor, u32 n)
+{
+    for (int i = 0; i < N_SCORES; i++) {
+        u64 score = ((u64) n << FIXED_SCALE_BITS) * i / (N_SCORES - 1);
+        check(parent, factor, n, (fixed_point_t) score);
+    }
+    check(parent, factor, n,
+          (fixed_point_t) (rand() % (n + 1)) << FIXED_SCALE_BITS);
+}
+
+/* Next count to test: every count up to twice the tables, then a geometric
+ * walk with odd offsets so that the scaled fallback drops low bits.
+ */
+static u32 next_count(u32 n)
+{
+    if (n < 2 * UCT_TABLE_SIZE)
+        return n + 1;
+    return n + n / 61 + 1;
+}
+
+int main(int argc, char *argv[])
+{
+    u32 max_parent = argc > 1 ? strtoul(argv[1], NULL, 0) : 3000000;
+    /* The score sums of larger counts overflow fixed_point_t */
+    if (max_parent > FIXED_MAX >> FIXED_SCALE_BITS)
+        max_parent = FIXED_MAX >> FIXED_SCALE_BITS;
+
+    fixed_init();
+    srand(1);
+
+    for (u32 parent = 2; parent <= max_parent; parent = next_count(parent)) {
+        u32 factor = uct_parent_factor(parent);
+        for (u32 n = 1; n <= parent; n = next_count(n) + n / 8)
+            check_child(parent, factor, n);
+        check_child(parent, factor, parent);
+    }
+
+    printf("max error %.6f at N = %u, n = %u, score = %u (bound %.6f)\n",
+           max_error, worst_parent, worst_n, worst_score, MAX_ERROR);
+    if (max_error > MAX_ERROR) {
+        printf("uct-check: FAILED\n");
+        return 1;
+    }
+    printf("uct-check: passed\n");
+    return 0;
+}
@@ -29,15 +29,21 @@ static unsigned char load_X[MAX_GAMES];
 
 #include "gamecount.h"
 char table_buf[MAX_GAMES][DRAWBUFFER_SIZE];
-char empty_board[DRAWBUFFER_SIZE] =
-    " | | | \n"
-    "-------\n"
-    " | | | \n"
-    "-------\n"
-    " | | | \n"
-    "-------\n"
-    " | | | \n"
-    "-------\n";
+
+/* Rows of " | | | " for 4x4, each followed by a line of dashes */
+static void draw_empty_board(char *buf)
+{
+    for (int r = 0; r < BOARD_SIZE; r++) {
+        char *row = buf + r * (BOARD_SIZE << 2);
+        for (int i = 0; i < (BOARD_SIZE << 1) - 1; i++) {
+            row[i] = i & 1 ? '|' : ' ';
+            row[(BOARD_SIZE << 1) + i] = '-';
+        }
+        row[(BOARD_SIZE << 1) - 1] = '\n';
+        row[(BOARD_SIZE << 2) - 1] = '\n';
+    }
+    buf[DRAWBUFFER_SIZE - 1] = '\0';
+}
 
 // Exit code after 3 seconds
 #include <signal.h>
@@ -322,11 +328,8 @@ static void display_co(void)
 
 int main(int argc, char *argv[])
 {
-    _Static_assert(DRAWBUFFER_SIZE >= sizeof(empty_board),
-                   "DRAWBUFFER_SIZE too small!");
-
     for (int i = 0; i < MAX_GAMES; i++)
-        memcpy(table_buf[i], empty_board, sizeof(empty_board));
+        draw_empty_board(table_buf[i]);
 
     if (ALARM_TIME > 0) {
         signal(SIGALRM, handle_alarm);
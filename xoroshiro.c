@@ -1,3 +1,5 @@
+#include <linux/kernel.h>
+
 #include "xoroshiro.h"
 
 static inline u64 rotl(const u64 x, int k)
@@ -24,16 +26,20 @@ u64 xoro_next(struct state_array *obj)
     return result;
 }
 
-void xoro_jump(struct state_array *obj)
+/* Uniform in [0, n) from the upper 32 bits, without a division */
+u32 xoro_bounded(struct state_array *obj, u32 n)
 {
-    static const u64 JUMP[] = {0xdf900294d8f554a5, 0x170865df4b3201fc};
+    return reciprocal_scale((u32) (xoro_next(obj) >> 32), n);
+}
 
+static void xoro_advance(struct state_array *obj, const u64 poly[2])
+{
     u64 s0 = 0;
     u64 s1 = 0;
     int i, b;
-    for (i = 0; i < sizeof(JUMP) / sizeof(*JUMP); i++) {
+    for (i = 0; i < 2; i++) {
         for (b = 0; b < 64; b++) {
-            if (JUMP[i] & (u64) (1) << b) {
+            if (poly[i] & (u64) (1) << b) {
                 s0 ^= obj->array[0];
                 s1 ^= obj->array[1];
             }
@@ -45,6 +51,31 @@ void xoro_jump(struct state_array *obj)
     obj->array[1] = s1;
 }
 
+/* Equivalent to 2^64 calls to xoro_next() */
+void xoro_jump(struct state_array *obj)
+{
+    static const u64 JUMP[] = {0xdf900294d8f554a5, 0x170865df4b3201fc};
+    xoro_advance(obj, JUMP);
+}
+
+/* Equivalent to 2^96 calls to xoro_next(), i.e. 2^32 xoro_jump() streams */
+void xoro_long_jump(struct state_array *obj)
+{
+    static const u64 LONG_JUMP[] = {0xd2a98b26625eee7b, 0xdddf9b1090aa7ac1};
+    xoro_advance(obj, LONG_JUMP);
+}
+
+/* Expand a 64-bit seed into a non-zero state with splitmix64 */
+void xoro_seed(struct state_array *obj, u64 s)
+{
+    for (int i = 0; i < 2; i++) {
+        u64 z = (s += 0x9e3779b97f4a7c15);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        obj->array[i] = z ^ (z >> 31);
+    }
+}
+
 void xoro_init(struct state_array *obj)
 {
     seed(obj, 314159265, 1618033989);
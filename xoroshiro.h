@@ -7,5 +7,8 @@ struct state_array {
 };
 
 u64 xoro_next(struct state_array *obj);
+u32 xoro_bounded(struct state_array *obj, u32 n);
 void xoro_jump(struct state_array *obj);
+void xoro_long_jump(struct state_array *obj);
+void xoro_seed(struct state_array *obj, u64 s);
 void xoro_init(struct state_array *obj);
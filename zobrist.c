@@ -1,14 +1,90 @@
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+#include <linux/moduleparam.h>
+#include <linux/percpu.h>
 #include <linux/slab.h>
-#include <linux/spinlock.h>
+#include <linux/sysfs.h>
 
 #include "zobrist.h"
 
 u64 zobrist_table[N_GRIDS][2];
 
-#define HASH(key) ((key) % HASH_TABLE_SIZE)
+/* The transposition table is a power-of-two array of cache-line sized
+ * buckets, each holding four entries. An entry is a packed data word and the
+ * key XORed with it, so a probe needs no lock: a slot torn by a concurrent
+ * store fails the XOR check and reads as a miss.
+ *
+ * Entries carry the depth they were searched to, so they stay valid for as
+ * long as they live: a later search, deeper or from a later move, uses them
+ * for cutoffs when they are deep enough and for move ordering otherwise.
+ * Starting a search only bumps the generation, which ages every entry in O(1).
+ *
+ * A store overwrites the slot of the same position, unless it holds a deeper
+ * result, or an empty one. Otherwise the first three slots are depth-preferred:
+ * an aged entry always gives way, a current one only to a search at least as
+ * deep. The last slot always takes the new entry.
+ */
+#define TT_BUCKET_ENTRIES 4
+
+struct tt_entry {
+    u64 check; /* key ^ data */
+    u64 data;
+};
+
+struct tt_bucket {
+    struct tt_entry entries[TT_BUCKET_ENTRIES];
+} __aligned(64);
+
+/* data: score in bits 0-31, move in 32-39, depth in 40-47, bound in 48-49,
+ * generation in 50-57
+ */
+#define TT_MOVE_SHIFT 32
+#define TT_DEPTH_SHIFT 40
+#define TT_BOUND_SHIFT 48
+#define TT_GENERATION_SHIFT 50
+#define TT_NO_MOVE 0xff
 
-static struct hlist_head *hash_table;
-static DEFINE_SPINLOCK(zobrist_lock);
+static unsigned int tt_size_mb = 2;
+module_param(tt_size_mb, uint, 0444);
+MODULE_PARM_DESC(tt_size_mb,
+                 "Negamax transposition table size in MiB, rounded down to "
+                 "a power of two");
+
+struct tt_stats {
+    u64 probes;
+    u64 hits;
+    u64 aged_hits; /* hits on entries of an earlier search */
+    u64 stores;
+    u64 collisions; /* stores that evicted another position */
+};
+
+static struct tt_bucket *tt;
+static unsigned long tt_mask;
+static u8 tt_generation;
+static DEFINE_PER_CPU(struct tt_stats, tt_stats);
+
+static inline u64 tt_pack(int score, int move, int depth, enum tt_bound bound)
+{
+    return (u32) score | (u64) (move < 0 ? TT_NO_MOVE : move) << TT_MOVE_SHIFT |
+           (u64) (u8) depth << TT_DEPTH_SHIFT | (u64) bound << TT_BOUND_SHIFT |
+           (u64) READ_ONCE(tt_generation) << TT_GENERATION_SHIFT;
+}
+
+static inline enum tt_bound tt_bound(u64 data)
+{
+    return (data >> TT_BOUND_SHIFT) & 3;
+}
+
+static inline int tt_depth(u64 data)
+{
+    return (u8) (data >> TT_DEPTH_SHIFT);
+}
+
+static inline bool tt_aged(u64 data)
+{
+    return (u8) (data >> TT_GENERATION_SHIFT) != READ_ONCE(tt_generation);
+}
 
 /* See https://github.com/wangyi-fudan/wyhash
  */
@@ -29,88 +105,127 @@ static u64 wyhash64(void)
     return wyhash64_stateless(&seed);
 }
 
-void zobrist_init(void)
+int zobrist_init(void)
 {
     int i;
     for (i = 0; i < N_GRIDS; i++) {
         zobrist_table[i][0] = wyhash64();
         zobrist_table[i][1] = wyhash64();
     }
-    hash_table =
-        kmalloc(sizeof(struct hlist_head) * HASH_TABLE_SIZE, GFP_KERNEL);
-    if (!hash_table) {
-        pr_info("kxo: Failed to allocate space for hash_table\n");
-        return;
+
+    unsigned long nr_buckets =
+        ((unsigned long) tt_size_mb << 20) / sizeof(struct tt_bucket);
+    nr_buckets = rounddown_pow_of_two(max(nr_buckets, 1UL));
+    tt = kvcalloc(nr_buckets, sizeof(struct tt_bucket), GFP_KERNEL);
+    if (!tt) {
+        pr_info("kxo: Failed to allocate the transposition table\n");
+        return -ENOMEM;
+    }
+    tt_mask = nr_buckets - 1;
+    return 0;
+}
+
+bool zobrist_get(u64 key, zobrist_entry_t *entry)
+{
+    const struct tt_bucket *b = &tt[key & tt_mask];
+
+    this_cpu_inc(tt_stats.probes);
+    for (int i = 0; i < TT_BUCKET_ENTRIES; i++) {
+        u64 data = READ_ONCE(b->entries[i].data);
+        if ((READ_ONCE(b->entries[i].check) ^ data) != key ||
+            tt_bound(data) == TT_NONE)
+            continue;
+        u8 move = data >> TT_MOVE_SHIFT;
+        entry->score = (s32) data;
+        entry->move = move == TT_NO_MOVE ? -1 : move;
+        entry->depth = tt_depth(data);
+        entry->bound = tt_bound(data);
+        this_cpu_inc(tt_stats.hits);
+        if (tt_aged(data))
+            this_cpu_inc(tt_stats.aged_hits);
+        return true;
     }
-    for (i = 0; i < HASH_TABLE_SIZE; i++)
-        INIT_HLIST_HEAD(&hash_table[i]);
+    return false;
 }
 
-zobrist_entry_t *zobrist_get(u64 key)
+void zobrist_put(u64 key, int score, int move, int depth, enum tt_bound bound)
 {
-    if (!hash_table) {
-        pr_info("kxo: ERROR, hash_table is NULL in zobrist.c\n");
-        return NULL;
+    struct tt_bucket *b = &tt[key & tt_mask];
+    struct tt_entry *slot = NULL;
+
+    for (int i = 0; i < TT_BUCKET_ENTRIES; i++) {
+        u64 data = READ_ONCE(b->entries[i].data);
+        if (tt_bound(data) == TT_NONE) {
+            slot = &b->entries[i];
+            break;
+        }
+        if ((READ_ONCE(b->entries[i].check) ^ data) == key) {
+            if (tt_depth(data) > depth)
+                return;
+            slot = &b->entries[i];
+            break;
+        }
     }
-    unsigned long flags;  // for spinlock
-    unsigned long long hash_key = HASH(key);
-
-    zobrist_entry_t *entry = NULL;
-
-    spin_lock_irqsave(&zobrist_lock, flags);  // lock
-    if (!hlist_empty(&hash_table[hash_key])) {
-        hlist_for_each_entry(entry, &hash_table[hash_key], ht_list) {
-            if (entry->key == key) {
-                // unlock before return
-                spin_unlock_irqrestore(&zobrist_lock, flags);
-                return entry;
+    if (!slot) {
+        int shallowest = depth + 1;
+        slot = &b->entries[TT_BUCKET_ENTRIES - 1];
+        for (int i = 0; i < TT_BUCKET_ENTRIES - 1; i++) {
+            u64 data = READ_ONCE(b->entries[i].data);
+            int d = tt_aged(data) ? -1 : tt_depth(data);
+            if (d < shallowest) {
+                shallowest = d;
+                slot = &b->entries[i];
             }
         }
+        this_cpu_inc(tt_stats.collisions);
     }
-    spin_unlock_irqrestore(&zobrist_lock, flags);  // unlock
-    return NULL;
+
+    u64 data = tt_pack(score, move, depth, bound);
+    WRITE_ONCE(slot->check, key ^ data);
+    WRITE_ONCE(slot->data, data);
+    this_cpu_inc(tt_stats.stores);
 }
 
-void zobrist_put(u64 key, int score, int move)
+void zobrist_new_search(void)
 {
-    if (!hash_table)  // null check for safety
-        return;
-    unsigned long flags;  // for spinlock
-    unsigned long long hash_key = HASH(key);
-    zobrist_entry_t *new_entry = kmalloc(sizeof(zobrist_entry_t), GFP_KERNEL);
-    new_entry->key = key;
-    new_entry->move = move;
-    new_entry->score = score;
-    spin_lock_irqsave(&zobrist_lock, flags);  // lock
-    hlist_add_head(&new_entry->ht_list, &hash_table[hash_key]);
-    spin_unlock_irqrestore(&zobrist_lock, flags);  // unlock
+    WRITE_ONCE(tt_generation, tt_generation + 1);
 }
 
+#ifdef ENGINE_BENCH
+/* engine-bench only: forget every entry, keeping the keys, so that a search
+ * runs from a cold table
+ */
 void zobrist_clear(void)
 {
-    if (!hash_table) {
-        pr_info("kxo: ERROR, hash_table is NULL in zobrist.c\n");
-        return;
-    }
-    unsigned long flags;                      // for spinlock
-    spin_lock_irqsave(&zobrist_lock, flags);  // lock
-    for (int i = 0; i < HASH_TABLE_SIZE; i++) {
-        while (!hlist_empty(&hash_table[i])) {
-            zobrist_entry_t *entry =
-                hlist_entry(hash_table[i].first, zobrist_entry_t, ht_list);
-            hlist_del(&entry->ht_list);
-            kfree(entry);
-        }
-        INIT_HLIST_HEAD(&hash_table[i]);
-    }
-    spin_unlock_irqrestore(&zobrist_lock, flags);  // unlock
+    memset(tt, 0, (tt_mask + 1) * sizeof(struct tt_bucket));
 }
+#endif
 
 void zobrist_free(void)
 {
-    if (hash_table) {
-        zobrist_clear();
-        kfree(hash_table);
-        hash_table = NULL;
+    kvfree(tt);
+    tt = NULL;
+}
+
+ssize_t zobrist_stats_show(char *buf)
+{
+    struct tt_stats sum = {0};
+    int cpu;
+
+    for_each_possible_cpu(cpu) {
+        const struct tt_stats *s = per_cpu_ptr(&tt_stats, cpu);
+        sum.probes += s->probes;
+        sum.hits += s->hits;
+        sum.aged_hits += s->aged_hits;
+        sum.stores += s->stores;
+        sum.collisions += s->collisions;
     }
-}
\ No newline at end of file
+    return sysfs_emit(buf,
+                      "buckets %lu\nbytes %lu\ngeneration %u\nprobes %llu\n"
+                      "hits %llu\nhit_rate_permille %llu\naged_hits %llu\n"
+                      "stores %llu\ncollisions %llu\n",
+                      tt_mask + 1, (tt_mask + 1) * sizeof(struct tt_bucket),
+                      READ_ONCE(tt_generation), sum.probes, sum.hits,
+                      sum.probes ? div64_u64(sum.hits * 1000, sum.probes) : 0,
+                      sum.aged_hits, sum.stores, sum.collisions);
+}
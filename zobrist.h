@@ -1,22 +1,77 @@
 #pragma once
 
-#include <linux/list.h>
+#include <linux/types.h>
 
-#include "game.h"
-
-#define HASH_TABLE_SIZE (100003)
+#include "bitboard.h"
 
 extern u64 zobrist_table[N_GRIDS][2];
 
+/* Zobrist keys of the eight images of a position, updated by every move. The
+ * smallest is the canonical key, shared by all positions equal up to
+ * symmetry, and the symmetry it came from maps moves to and from the
+ * canonical orientation.
+ */
+struct zobrist_keys {
+    u64 keys[N_SYMMETRIES];
+};
+
+/* Toggles the grid, so playing the same move again takes it back */
+static inline void zobrist_keys_play(struct zobrist_keys *z,
+                                     int move,
+                                     char player)
+{
+    for (int s = 0; s < N_SYMMETRIES; s++)
+        z->keys[s] ^= zobrist_table[sym_cells[s][move]][player == 'X'];
+}
+
+static inline u64 zobrist_canonical(const struct zobrist_keys *z, int *sym)
+{
+    u64 key = z->keys[0];
+    *sym = 0;
+    for (int s = 1; s < N_SYMMETRIES; s++) {
+        if (z->keys[s] < key) {
+            key = z->keys[s];
+            *sym = s;
+        }
+    }
+    return key;
+}
+
+/* Map a move between the position and its canonical orientation, keeping -1
+ * for no move.
+ */
+static inline int zobrist_to_canonical(int sym, int move)
+{
+    return move < 0 ? move : sym_cells[sym][move];
+}
+
+static inline int zobrist_from_canonical(int sym, int move)
+{
+    return move < 0 ? move : sym_inverse[sym][move];
+}
+
+/* How a stored score relates to the true value of the position */
+enum tt_bound {
+    TT_NONE, /* empty slot */
+    TT_EXACT,
+    TT_LOWER, /* failed high, the value is at least score */
+    TT_UPPER, /* failed low, the value is at most score */
+};
+
+/* Unpacked copy of a transposition table entry */
 typedef struct {
-    u64 key;
     int score;
-    int move;
-    struct hlist_node ht_list;
+    int move; /* -1 when no move was searched */
+    int depth;
+    enum tt_bound bound;
 } zobrist_entry_t;
 
-void zobrist_init(void);
-zobrist_entry_t *zobrist_get(u64 key);
-void zobrist_put(u64 key, int score, int move);
+int zobrist_init(void);
+bool zobrist_get(u64 key, zobrist_entry_t *entry);
+void zobrist_put(u64 key, int score, int move, int depth, enum tt_bound bound);
+void zobrist_new_search(void);
+#ifdef ENGINE_BENCH
 void zobrist_clear(void);
-void zobrist_free(void);
\ No newline at end of file
+#endif
+void zobrist_free(void);
+ssize_t zobrist_stats_show(char *buf);